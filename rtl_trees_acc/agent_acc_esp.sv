@@ -6,6 +6,9 @@ interface esp_acc_if;
     // << User-defined configuration registers >>
     logic [31:0] conf_info_load_trees;      // FLAG: load trees
     logic [31:0] conf_info_burst_len;       // Burst length
+    logic [31:0] conf_info_vote_counts;     // FLAG: return per-class votes instead of the winner
+    logic [31:0] conf_info_tree_offset;     // First tree to load
+    logic [31:0] conf_info_tree_count;      // Trees to load, 0 loads all of them
 
     logic conf_done;                        // One-cycle pulse indicating that configuration registers are valid
 
@@ -44,6 +47,8 @@ class agent_esp_acc;
 
     parameter N_NODES = 256;        // Number of nodes in each tree
     parameter N_TREES = 128;        // Number of trees in the forest
+    parameter N_CLASES = 5;         // Classes voted by the DUT
+    parameter VOTE_WORDS = 1;       // 64-bit words of votes per sample in the DUT
 
     parameter N_SAMPLES = 10000;    // Number of samples
     parameter COLUMNAS = 33;        // 32 features + 1 label
@@ -63,11 +68,19 @@ class agent_esp_acc;
     int predictions_count = 0;
     int mismatches_count = 0;
 
+    // Process clock cycles of the inference runs, to compare designs
+    longint process_cycles = 0;
+    int processed_samples = 0;
+
+    // Per-class votes of the gold model
+    bit [7:0] counts_sw[N_SAMPLES-1:0][32];
+
     // Simulated memory array accessed by the DMA
     bit [63:0] mem[*];
 
 
     int unsigned burst_len_1;
+    int unsigned burst_first_1;     // First sample of the resident burst
 
     // Constructor: bind the interface and reset relevant signals
     function new(virtual esp_acc_if esp_if);
@@ -122,10 +135,28 @@ class agent_esp_acc;
         end
     endtask
 
+    // Compare the per-class votes of the resident burst with the gold model
+    local task read_votes(int n_samples);
+        bit [7:0] count;
+        for (int s = 0; s < n_samples; s++) begin
+            for (int c = 0; c < N_CLASES; c++) begin
+                count = mem[read_index + s*VOTE_WORDS + c/8][8*(c%8)+: 8];
+                if (count != counts_sw[burst_first_1 + s][c]) begin
+                    mismatches_count++;
+                    $display("Mismatch votes sample %0d class %0d: sw=%0d hw=%0d",
+                             burst_first_1 + s, c, counts_sw[burst_first_1 + s][c], count);
+                    $stop;
+                end
+            end
+        end
+    endtask
+
     // Reset agent
     task reset();
         predictions_count = 0;
         mismatches_count = 0;
+        process_cycles = 0;
+        processed_samples = 0;
     endtask
 
     // Extract a block of data from simulated memory
@@ -148,22 +179,33 @@ class agent_esp_acc;
         $display("Correct predictions hw: %0d of %0d", correct, 10000);
         $display("Accuracy: %f", (correct / 10000.0));
         $display("Mismatches hw, sw: %0d", mismatches_count);
+        if (processed_samples)
+            $display("Process clk cicles: %0d for %0d samples, %f per sample",
+                     process_cycles, processed_samples, real'(process_cycles) / processed_samples);
     endfunction
 
     // Drive the full accelerator transaction emulating
     // the ESP interface and handling DMA read/write operations
     // emulation of the SW stack when using the accelerator
     task run(input int unsigned load_trees,
-             input int unsigned burst_len);
+             input int unsigned burst_len,
+             input int unsigned vote_counts = 0,
+             input int unsigned tree_offset = 0,
+             input int unsigned tree_count = 0);
 
         bit [31:0] clk_stamp1, clk_stamp2; 
 
-        if (burst_len)
+        if (burst_len) begin
             burst_len_1 = burst_len;
+            burst_first_1 = predictions_count;
+        end
 
         // CONFIG PHASE: apply registers
         esp_if.conf_info_load_trees = load_trees;
         esp_if.conf_info_burst_len = burst_len;
+        esp_if.conf_info_vote_counts = vote_counts;
+        esp_if.conf_info_tree_offset = tree_offset;
+        esp_if.conf_info_tree_count = tree_count;
         @(posedge esp_if.clk);
         esp_if.conf_done      = 1;
         @(posedge esp_if.clk);
@@ -209,6 +251,10 @@ class agent_esp_acc;
                 @(posedge esp_if.clk iff esp_if.dma_write_chnl_ready && esp_if.dma_write_chnl_valid);
                 {clk_stamp1, clk_stamp2} = esp_if.dma_write_chnl_data;
                 $display("Clock stamps: send %0d, process %0d clk cicles", clk_stamp1, clk_stamp2);
+                if (!load_trees) begin
+                    process_cycles += clk_stamp2;
+                    processed_samples += burst_len_1;
+                end
             end
             i++;
         end
@@ -216,12 +262,23 @@ class agent_esp_acc;
         esp_if.dma_write_chnl_ready = 0;
         @(posedge esp_if.clk);
 
+        // Tree loads write the capability word of the build before the stamps
+        if (load_trees) begin
+            $display("Capabilities: vote counts %0d", mem[write_index][0]);
+            if (!mem[write_index][0]) begin
+                $display("The DUT has no per-class vote output, the vote tests need VOTE_COUNTS=1");
+                $stop;
+            end
+        end
+
         // WAIT for accelerator to assert acc_done
         wait (esp_if.acc_done == 1);
         @(posedge esp_if.clk);
 
         // Read predictions from memory
-        if (!load_trees)
+        if (!load_trees && vote_counts)
+            read_votes(burst_len_1);
+        else if (!load_trees)
             read_predictions(burst_len_1, (burst_len) ? 1 : 0);
 
 endtask
@@ -294,6 +351,8 @@ endtask
             end
     
             predictions_sw[p] = best;
+            for (int c = 0; c < 32; c++)
+                counts_sw[p][c] = counts[c];
             $display("Prediction %0d: %0h", p, predictions_sw[p]);
         end
 
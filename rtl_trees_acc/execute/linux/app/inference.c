@@ -0,0 +1,138 @@
+#include "inference.h"
+
+/*
+ * Adds the vote of each of the n_trees trees for one sample, walking them one
+ * by one. The feature index is taken modulo N_FEATURE, as the accelerator
+ * keeps only its low bits, so a bad index never reads past the sample.
+ */
+static void scalar_votes(const tree_data *tree, int n_trees, const float features[N_FEATURE],
+                            uint16_t counts[N_CLASSES])
+{
+    int32_t leaf_value;
+
+    for (int t = 0; t < n_trees; t++) {
+        uint8_t node_index = 0;
+        uint8_t node_right;
+        uint8_t node_left;
+        uint8_t feature_index;
+        float_int_union_t feature;
+        tree_data tree_data;
+
+        while (1) {
+            tree_data     = tree[t * N_NODE_AND_LEAFS + node_index];
+            feature_index = tree_data.tree_camps.feature_index % N_FEATURE;
+            feature.f     = features[feature_index];
+            node_left     = node_index + 1;
+            node_right    = tree_data.tree_camps.next_node_right_index;
+
+            node_index = feature.i < tree_data.tree_camps.float_int_union.i ? node_left :
+                                                                               node_right;
+
+            if (!(tree_data.tree_camps.leaf_or_node & 0x01)) break;
+        }
+
+        leaf_value = tree_data.tree_camps.float_int_union.i;
+        if (leaf_value >= 0 && leaf_value < N_CLASSES) { counts[leaf_value]++; }
+    }
+}
+
+void make_prediction(const tree_data *tree, const float features[N_FEATURE], int32_t *prediction)
+{
+    uint16_t counts[N_CLASSES] = {0};
+
+    scalar_votes(tree, N_TREES, features, counts);
+    *prediction = vote_winner(counts);
+}
+
+/*
+ * Software engine: make_prediction() on every sample, over n_trees
+ * trees so split models are voted as a whole, with the samples spread over
+ * n_threads host cores.
+ */
+void predict_scalar_parallel(const tree_data *tree, int n_trees, const float *features,
+                    size_t stride, int n_samples, uint8_t *predictions, int n_threads)
+{
+    #pragma omp parallel for schedule(static) num_threads(n_threads)
+    for (int s = 0; s < n_samples; s++) {
+        uint16_t counts[N_CLASSES] = {0};
+
+        scalar_votes(tree, n_trees, &features[s * stride], counts);
+        predictions[s] = vote_winner(counts);
+    }
+}
+
+/*
+ * Class with the most votes, the lowest class on a tie like the voting of
+ * the accelerator.
+ */
+uint8_t vote_winner(const uint16_t votes[N_CLASSES])
+{
+    uint8_t best = 0;
+
+    for (int c = 1; c < N_CLASSES; c++) {
+        if (votes[c] > votes[best]) best = c;
+    }
+
+    return best;
+}
+
+// FNV-1a over the node words, used to pair a model.bin with the code built from it
+uint64_t model_hash(const tree_data *tree)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (int n = 0; n < N_TREES * N_NODE_AND_LEAFS; n++) {
+        for (int b = 0; b < 64; b += 8) {
+            hash ^= (tree[n].compact_data >> b) & 0xff;
+            hash *= 0x100000001b3ULL;
+        }
+    }
+
+    return hash;
+}
+
+compiled_predict_t load_compiled_model(const char *filename, const tree_data *tree)
+{
+    void *handle = dlopen(filename, RTLD_NOW | RTLD_LOCAL);
+    const uint64_t *hash;
+    const int *n_trees;
+    compiled_predict_t predict;
+
+    if (handle == NULL) {
+        printf("Error opening the compiled model %s: %s\n", filename, dlerror());
+        return NULL;
+    }
+
+    hash    = dlsym(handle, "compiled_model_hash");
+    n_trees = dlsym(handle, "compiled_n_trees");
+    predict = (compiled_predict_t)dlsym(handle, "compiled_predict");
+
+    if (hash == NULL || n_trees == NULL || predict == NULL) {
+        printf("%s is not a compiled trees model\n", filename);
+        dlclose(handle);
+        return NULL;
+    }
+
+    if (*n_trees != N_TREES || *hash != model_hash(tree)) {
+        printf("%s was not generated from the loaded model\n", filename);
+        dlclose(handle);
+        return NULL;
+    }
+
+    printf("Loaded compiled model from %s\n", filename);
+    return predict;
+}
+
+void predict_compiled_parallel(compiled_predict_t predict, const float *features, size_t stride,
+                    int n_samples, uint8_t *predictions, int n_threads)
+{
+    int n_blocks = (n_samples + BATCH_LANES - 1) / BATCH_LANES;
+
+    #pragma omp parallel for schedule(static) num_threads(n_threads)
+    for (int b = 0; b < n_blocks; b++) {
+        int s = b * BATCH_LANES;
+        int lanes = n_samples - s < BATCH_LANES ? n_samples - s : BATCH_LANES;
+
+        predict(&features[s * stride], stride, lanes, &predictions[s]);
+    }
+}
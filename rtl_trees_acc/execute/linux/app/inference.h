@@ -0,0 +1,60 @@
+#ifndef __INFERENCE_H__
+#define __INFERENCE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include <dlfcn.h>
+
+#define N_NODE_AND_LEAFS 256    // Adjust according to the maximum number of nodes and leaves in your trees
+#define N_TREES 128             // Adjust according to the number of trees in your model
+#define N_FEATURE 32            // Adjust according to the number of features in your model
+#define MAX_LINE_LENGTH 1024    // Adjust according to the maximum line length in your CSV file
+#define N_CLASSES 32            // Adjust according to the number of classes in your model
+#define MAX_BURST 5000          // Adjust according to the maximum amount of somples to process in 1 busrt
+
+#define BATCH_LANES 16          // Samples per block handed to a compiled model
+#define PIPELINE_DEPTH 3        // DMA buffers in flight by default: parsing, accelerator, draining
+#define MAX_PIPELINE_DEPTH 8
+#define VOTE_WORDS 4            // 64-bit words of per-class votes per sample in vote count mode
+
+
+typedef union {
+  float f;
+  int32_t i;
+} float_int_union_t;
+
+struct tree_camps {
+  uint8_t leaf_or_node;
+  uint8_t feature_index;
+  uint8_t next_node_right_index;
+  uint8_t padding;
+  float_int_union_t float_int_union;
+};
+
+typedef union {
+  struct tree_camps tree_camps;
+  uint64_t compact_data;
+} tree_data;
+
+// Entry point exported by the shared objects built from codegen/trees_codegen
+typedef void (*compiled_predict_t)(const float *features, size_t stride,
+                                    int n_samples, uint8_t *predictions);
+
+void make_prediction(const tree_data *tree, const float features[N_FEATURE], int32_t *prediction);
+
+uint8_t vote_winner(const uint16_t votes[N_CLASSES]);
+
+void predict_scalar_parallel(const tree_data *tree, int n_trees, const float *features,
+                    size_t stride, int n_samples, uint8_t *predictions, int n_threads);
+
+uint64_t model_hash(const tree_data *tree);
+
+compiled_predict_t load_compiled_model(const char *filename, const tree_data *tree);
+
+void predict_compiled_parallel(compiled_predict_t predict, const float *features, size_t stride,
+                    int n_samples, uint8_t *predictions, int n_threads);
+
+#endif // __INFERENCE_H__
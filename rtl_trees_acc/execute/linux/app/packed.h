@@ -0,0 +1,49 @@
+#ifndef __PACKED_H__
+#define __PACKED_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Pre-packed dataset file, written by pack/trees_pack. After a 64-byte header
+ * the body is already in the feature burst layout of the accelerator:
+ * n_samples rows of n_features little-endian floats, followed by one uint8
+ * label per sample. Same copy in execute/ and train/.
+ */
+#define PACKED_MAGIC "features"
+#define PACKED_HEADER_SIZE 64
+
+struct packed_header {
+    char magic[8];
+    uint32_t n_samples;
+    uint32_t n_features;    // floats stored per sample
+    uint32_t n_columns;     // feature columns of the source file
+    uint8_t reserved[PACKED_HEADER_SIZE - 20];
+};
+
+struct packed_dataset {
+    void *map;
+    size_t map_size;
+    uint32_t n_samples;
+    uint32_t n_features;
+    uint32_t n_columns;
+    const float *features;
+    const uint8_t *labels;
+};
+
+int is_packed_dataset(const char *filename);
+
+int map_packed_dataset(const char *filename, struct packed_dataset *dataset);
+
+void unmap_packed_dataset(struct packed_dataset *dataset);
+
+void copy_packed_samples(const struct packed_dataset *dataset, uint32_t first, uint32_t n,
+                            float *features, size_t stride, uint8_t *labels);
+
+int write_packed_header(FILE *file, uint32_t n_samples, uint32_t n_features, uint32_t n_columns);
+
+int write_packed_features(FILE *file, const float *features, size_t n_floats);
+
+#endif // __PACKED_H__
@@ -0,0 +1,129 @@
+#include "parse.h"
+
+// Significant digits that always fit in the 64-bit mantissa
+#define MAX_MANTISSA_DIGITS 19
+
+// Powers of ten that are exact in a double
+static const double pow10_exact[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static int is_delimiter(char c)
+{
+    return c == ',' || c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static int is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+/*
+ * Parses the number at *cursor and leaves *cursor right after it. When the
+ * digits fit in 53 bits and the decimal exponent in [-22, 22] both the
+ * mantissa and the power of ten are exact doubles, so a single multiply or
+ * divide gives the correctly rounded double, and the result matches atof()
+ * bit for bit. Anything else (long mantissas, large exponents, inf, nan, hex)
+ * goes through strtod().
+ */
+float parse_float(const char **cursor)
+{
+    const char *start = *cursor;
+    const char *p = start;
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    int negative = 0;
+    int seen_digit = 0;
+    double value;
+
+    if (*p == '-' || *p == '+')
+        negative = *p++ == '-';
+
+    for (; is_digit(*p); p++) {
+        seen_digit = 1;
+        if (mantissa == 0 && *p == '0') continue;
+        if (++digits > MAX_MANTISSA_DIGITS) goto slow;
+        mantissa = mantissa * 10 + (*p - '0');
+    }
+
+    if (*p == '.') {
+        for (p++; is_digit(*p); p++) {
+            seen_digit = 1;
+            exponent--;
+            if (mantissa == 0 && *p == '0') continue;
+            if (++digits > MAX_MANTISSA_DIGITS) goto slow;
+            mantissa = mantissa * 10 + (*p - '0');
+        }
+    }
+
+    if (!seen_digit) goto slow;
+
+    if (*p == 'e' || *p == 'E') {
+        int exp_negative = 0;
+        int exp_value = 0;
+
+        p++;
+        if (*p == '-' || *p == '+')
+            exp_negative = *p++ == '-';
+        if (!is_digit(*p)) goto slow;
+        for (; is_digit(*p); p++) {
+            if (exp_value < 10000) exp_value = exp_value * 10 + (*p - '0');
+        }
+        exponent += exp_negative ? -exp_value : exp_value;
+    }
+
+    if (mantissa >> 53 || exponent < -22 || exponent > 22) goto slow;
+
+    value = (double)mantissa;
+    if (exponent < 0)
+        value /= pow10_exact[-exponent];
+    else
+        value *= pow10_exact[exponent];
+
+    *cursor = p;
+    return negative ? -(float)value : (float)value;
+
+slow:
+    {
+        char *end;
+
+        value = strtod(start, &end);
+        *cursor = end;
+        return (float)value;
+    }
+}
+
+/*
+ * Parses up to max_values + 1 numbers of a row: the last one read is stored
+ * in label and the ones before it in values. Returns the number of values
+ * stored, or -1 if the row has no numbers.
+ */
+int parse_row(const char *line, float *values, int max_values, float *label)
+{
+    const char *p = line;
+    float pending = 0;
+    int count = 0;
+
+    while (is_delimiter(*p)) p++;
+
+    while (*p && count < max_values + 1) {
+        float value = parse_float(&p);
+
+        // Skip the rest of a malformed field, as atof() would ignore it
+        while (*p && !is_delimiter(*p)) p++;
+        while (is_delimiter(*p)) p++;
+
+        if (count > 0)
+            values[count - 1] = pending;
+        pending = value;
+        count++;
+    }
+
+    if (count == 0)
+        return -1;
+
+    *label = pending;
+    return count - 1;
+}
@@ -1,8 +1,13 @@
 // Copyright (c) 2011-2024 Columbia University, System Level Design Group
 // SPDX-License-Identifier: Apache-2.0
+#include <unistd.h>
+#include <pthread.h>
 #include "libesp.h"
 #include "cfg.h"
 #include "monitors.h"
+#include "inference.h"
+#include "parse.h"
+#include "packed.h"
 
 static unsigned in_words_adj;
 static unsigned out_words_adj;
@@ -18,78 +23,125 @@ union stamps{
     uint64_t data;
 };
 
-int read_n_features(const char *csv_file, int n, struct feature *features, 
-                    token_t *features_buff[MAX_BURST*N_FEATURE]) {
-    FILE *file = fopen(csv_file, "r");
+// Dataset being streamed, either a text file or a mapped packed file
+struct dataset_stream {
+    FILE *file;
+    struct packed_dataset packed;
+    uint32_t next_sample;
+};
+
+int open_dataset(const char *filename, struct dataset_stream *stream)
+{
+    memset(stream, 0, sizeof(*stream));
+
+    if (is_packed_dataset(filename))
+        return map_packed_dataset(filename, &stream->packed);
+
+    stream->file = fopen(filename, "r");
+    if (!stream->file) {
+        printf("Failed to open the features file %s\n", filename);
+        return -1;
+    }
+
+    return 0;
+}
+
+void close_dataset(struct dataset_stream *stream)
+{
+    if (stream->file)
+        fclose(stream->file);
+    else
+        unmap_packed_dataset(&stream->packed);
+}
+
+/*
+ * Reads up to n samples of the dataset straight into a DMA buffer, one row of
+ * N_FEATURE floats per sample, and the label of every sample into labels.
+ * Text rows, CSV or space separated, are parsed; packed rows are copied.
+ * Returns the number of samples read, 0 at the end of the dataset.
+ */
+int read_features_chunk(struct dataset_stream *stream, int n, float *features, uint8_t *labels)
+{
     char line[MAX_LINE_LENGTH];
     int read_samples = 0;
-    int i, block_i, local_i;
-    float* ptr_32;
+    int i, n_values;
+    float label;
 
-    if (!file) {
-        printf("Failed to open the features file %s\n", csv_file);
-        return -1;
+    if (!stream->file) {
+        uint32_t left = stream->packed.n_samples - stream->next_sample;
+
+        read_samples = left < n ? left : n;
+        copy_packed_samples(&stream->packed, stream->next_sample, read_samples, features,
+                            N_FEATURE, labels);
+        stream->next_sample += read_samples;
+        return read_samples;
     }
 
-    
-    while (fgets(line, MAX_LINE_LENGTH, file) && read_samples < n) {
-        block_i = read_samples/MAX_BURST;
-        local_i = read_samples%MAX_BURST;
-        // Set the pointer to the new block of features
-        ptr_32 = (float*)features_buff[block_i];
-        float temp[N_FEATURE + 1];
-        char *token = strtok(line, ",");
-        int index = 0;
-
-        while (token != NULL && index < N_FEATURE + 1) {
-            temp[index] = atof(token);
-            token = strtok(NULL, ",");
-            index++;
-        }
+    while (read_samples < n && fgets(line, MAX_LINE_LENGTH, stream->file)) {
+        float *row = &features[read_samples * N_FEATURE];
 
-        for (i = 0; i < index - 1; i++) {
-            features[read_samples].features[i] = temp[i];
-            // Store the features in the block
-            ptr_32[local_i * N_FEATURE + i]  = temp[i];
-        }
-        features[read_samples].prediction = (uint8_t) temp[index - 1];
+        n_values = parse_row(line, row, N_FEATURE, &label);
+        if (n_values < 1)
+            continue;
+
+        for (i = n_values; i < N_FEATURE; i++)
+            row[i] = 0;
+        labels[read_samples] = (uint8_t) label;
 
         read_samples++;
     }
 
-    fclose(file);
-    printf("Read %d features from %s\n", read_samples, csv_file);
     return read_samples;
 }
 
-void load_model(token_t *tree_buf, const char *filename)
+/*
+ * Reads every tree of the model file. A tile holds N_TREES trees, so larger
+ * models are split in groups of N_TREES and the last group is padded with
+ * trees whose root is a leaf that votes for no class. Returns the model and
+ * its padded tree count, a multiple of N_TREES, in n_trees.
+ */
+tree_data *load_model(const char *filename, int *n_trees)
 {
+    const tree_data no_vote = {.tree_camps = {.leaf_or_node = 0, .float_int_union.i = -1}};
+    const size_t tree_size = sizeof(tree_data) * N_NODE_AND_LEAFS;
     char magic_number[5] = {0};
+    tree_data *model;
+    long file_size;
+    int n_read, n_groups;
     FILE *file = fopen(filename, "rb");
     if (file == NULL) {
         printf("Error opening the model file %s\n", filename);
-        return;
+        return NULL;
     }
 
-    fread(magic_number, 5, 1, file);
+    fseek(file, 0, SEEK_END);
+    file_size = ftell(file);
+    rewind(file);
 
-    if (!memcmp(magic_number, "model", 5)) {
-        for (int t = 0; t < N_TREES; t++) {
-            for (int n = 0; n < N_NODE_AND_LEAFS; n++) {
-                fread(&tree_buf[t * N_NODE_AND_LEAFS + n], sizeof(uint64_t), 1, file);
-                if (t == 0 && n == 0){
-                    printf("Dato en sdad hexadecimal: 0x%" PRIx64 "\n", tree_buf[0]);
-                }
-            }
-        }
-    }
-    else {
+    if (fread(magic_number, 5, 1, file) != 1 || memcmp(magic_number, "model", 5)) {
         printf("Unknown file type\n");
+        fclose(file);
+        return NULL;
+    }
+
+    n_read   = (file_size - 5) / tree_size;
+    n_groups = n_read ? (n_read + N_TREES - 1) / N_TREES : 1;
+    model    = malloc(tree_size * n_groups * N_TREES);
+    if (model == NULL || fread(model, tree_size, n_read, file) != n_read) {
+        printf("Error reading the model file %s\n", filename);
+        free(model);
+        fclose(file);
+        return NULL;
     }
+    for (int n = n_read * N_NODE_AND_LEAFS; n < n_groups * N_TREES * N_NODE_AND_LEAFS; n++)
+        model[n] = no_vote;
 
-    printf("Loaded model from %s\n", filename);
+    printf("Dato en sdad hexadecimal: 0x%" PRIx64 "\n", model[0].compact_data);
+    printf("Loaded %i trees from %s\n", n_read, filename);
 
     fclose(file);
+    *n_trees = n_groups * N_TREES;
+    return model;
 }
 
 /* User-defined code */
@@ -106,281 +158,590 @@ static void init_parameters()
     size       = (out_offset * sizeof(token_t)) + out_size;
 }
 
-void send_trees(token_t *buf)
+static char tile_devnames[MAX_TILES][32];
+
+// Bit of the capability word a tile writes before the stamps of a tree load
+#define TILE_CAP_VOTE_COUNTS 0x1
+
+/*
+ * Counts the /dev/trees_rtl.N devices, which the driver numbers from 0 in
+ * probe order, up to max_tiles. Falls back to the single tile of cfg.h when
+ * none is found so esp_run() reports the missing device.
+ */
+int discover_tiles(int max_tiles)
+{
+    char path[64];
+    int n = 0;
+
+    while (n < max_tiles) {
+        snprintf(path, sizeof(path), "/dev/%s.%d", TILE_DEVNAME, n);
+        if (access(path, F_OK))
+            break;
+        n++;
+    }
+
+    return n ? n : 1;
+}
+
+/*
+ * Clones the descriptor of tile 0 in cfg.h for the n_tiles first instances
+ * and reads their capability words with a tree load of no tree, which only
+ * writes the capability word and the stamps. A model split in n_groups > 1
+ * groups needs the per-class votes on the n_groups first tiles, it is
+ * refused when one of them was built without VOTE_COUNTS.
+ */
+int init_tiles(int n_tiles, int n_groups)
+{
+    token_t *bufs[MAX_TILES];
+    int ret = 0;
+
+    for (int t = 0; t < n_tiles; t++) {
+        trees_cfg_000[t] = trees_cfg_000[0];
+        cfg_000[t] = cfg_000[0];
+        snprintf(tile_devnames[t], sizeof(tile_devnames[t]), "%s.%d", TILE_DEVNAME, t);
+        cfg_000[t].devname  = tile_devnames[t];
+        cfg_000[t].esp_desc = &trees_cfg_000[t].esp;
+
+        bufs[t] = (token_t *)esp_alloc(2 * sizeof(token_t));
+        trees_cfg_000[t].burst_len   = 0;
+        trees_cfg_000[t].load_trees  = 1;
+        trees_cfg_000[t].tree_offset = N_TREES;
+        cfg_000[t].hw_buf            = bufs[t];
+    }
+    esp_run(cfg_000, n_tiles);
+
+    for (int t = 0; t < n_tiles; t++) {
+        if (t < n_groups && n_groups > 1 && !(bufs[t][0] & TILE_CAP_VOTE_COUNTS)) {
+            printf("Tile %i has no per-class vote output, build it with VOTE_COUNTS=1 "
+                    "to split the model\n", t);
+            ret = 1;
+        }
+        trees_cfg_000[t].tree_offset = TREE_OFFSET;
+        esp_free(bufs[t]);
+    }
+
+    return ret;
+}
+
+// Loads each tile with its buffer of trees, the tiles write their capabilities
+// over buf[0] and their stamps over buf[1]
+void send_trees(token_t *bufs[], int n_tiles)
 {
     
     union stamps u_stamps;
 
-    printf("Sending trees...\n");
-    trees_cfg_000[0].burst_len = 0;
-    trees_cfg_000[0].load_trees = 1;
-    cfg_000[0].hw_buf                 = buf;
-    esp_run(cfg_000, NACC);
-    memcpy(&u_stamps.data, &buf[0], sizeof(uint64_t));
-    printf(" - Send trees clock stamps: send %i, process %i clk cicles\n", u_stamps.clk[1], u_stamps.clk[0]);
+    printf("Sending trees to %i tiles...\n", n_tiles);
+    for (int t = 0; t < n_tiles; t++) {
+        trees_cfg_000[t].burst_len = 0;
+        trees_cfg_000[t].load_trees = 1;
+        cfg_000[t].hw_buf                 = bufs[t];
+    }
+    esp_run(cfg_000, n_tiles);
+    for (int t = 0; t < n_tiles; t++) {
+        memcpy(&u_stamps.data, &bufs[t][1], sizeof(uint64_t));
+        printf(" - Send trees clock stamps tile %i: send %i, process %i clk cicles\n", t,
+                u_stamps.clk[1], u_stamps.clk[0]);
+    }
 
 }
 
-void perform_inferences_hw(token_t *buf, int read_samples, uint8_t *predictions, 
-                            float *exe_time_ms)
-{
+enum slot_state {
+    SLOT_FREE,      // owned by the host, being filled or drained
+    SLOT_READY,     // features in place, waiting for the accelerator
+    SLOT_DONE       // processed by the accelerator, waiting to be drained
+};
 
-    esp_monitor_args_t mon_args = {
-        .read_mode  = ESP_MON_READ_ALL,
-        .read_mask  = 0,                  // no usado en READ_ALL
-        .tile_index = 2,                  // ej.: tile (1,0) => índice 2
-        .acc_index  = 0,                  // no usado en READ_ALL
-        .mon_index  = 0,                  // no usado en READ_ALL
-        .noc_index  = 0                   // no usado en READ_ALL
-    };
+/*
+ * One round of the pipeline: a DMA buffer per tile and the host side data of
+ * the samples in them. Every tile but the last one of a round gets a full
+ * burst, so sample i of tile t is at t * MAX_BURST + i of the round.
+ */
+struct burst_slot {
+    token_t *buf[MAX_TILES];
+    int tile_burst[MAX_TILES];
+    int n_active;           // tiles with samples in this round
+    int burst;              // samples in this round
+    int first_sample;
+    int votes;              // tiles return the per-class votes of their group of trees
+    enum slot_state state;
+    uint8_t labels[MAX_TILES * MAX_BURST];
+    uint8_t predictions_sw[MAX_TILES * MAX_BURST];
+    float exe_time_ms;
+    esp_monitor_vals_t vals_start, vals_end;
+};
 
+struct burst_pipeline {
+    struct burst_slot slots[MAX_PIPELINE_DEPTH];
+    int depth;
+    int finished;           // set once the last burst has been submitted
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+};
+
+static esp_monitor_args_t mon_args = {
+    .read_mode  = ESP_MON_READ_ALL,
+    .read_mask  = 0,                  // no usado en READ_ALL
+    .tile_index = 2,                  // ej.: tile (1,0) => índice 2
+    .acc_index  = 0,                  // no usado en READ_ALL
+    .mon_index  = 0,                  // no usado en READ_ALL
+    .noc_index  = 0                   // no usado en READ_ALL
+};
+
+// Runs one round on the active tiles concurrently, only the esp_run() is timed
+void perform_inferences_hw(struct burst_slot *slot)
+{
     struct timespec startn, endn;
-    esp_monitor_vals_t vals_start, vals_end, vals_diff;
-    unsigned long long hw_ns;
-    union stamps u_stamps;
 
-    printf("Performing inferences...\n");
-    esp_monitor(mon_args, &vals_start);
+    esp_monitor(mon_args, &slot->vals_start);
     gettime(&startn);
-    trees_cfg_000[0].burst_len = read_samples;
-    trees_cfg_000[0].load_trees = 0;
-    cfg_000[0].hw_buf = buf;
-    esp_run(cfg_000, NACC);
+    for (int t = 0; t < slot->n_active; t++) {
+        trees_cfg_000[t].burst_len = slot->tile_burst[t];
+        trees_cfg_000[t].load_trees = 0;
+        trees_cfg_000[t].vote_counts = slot->votes;
+        cfg_000[t].hw_buf = slot->buf[t];
+    }
+    esp_run(cfg_000, slot->n_active);
     gettime(&endn);
-    esp_monitor(mon_args, &vals_end);
-    hw_ns = ts_subtract(&startn, &endn);
-    *exe_time_ms = hw_ns/1000000.0;
-    printf("  > Hardware test time: %f ms\n", *exe_time_ms);
-    
-    vals_diff = esp_monitor_diff(vals_start, vals_end);
+    esp_monitor(mon_args, &slot->vals_end);
+    slot->exe_time_ms = ts_subtract(&startn, &endn) / 1000000.0;
+}
+
+/*
+ * Model parallel reducer: every tile of the round voted on the same samples
+ * with its own group of trees, one byte per class. The votes of the groups
+ * are added up and the winner is picked with the tie rule of the accelerator.
+ */
+static void reduce_votes(const struct burst_slot *slot, uint8_t *predictions)
+{
+    for (int s = 0; s < slot->burst; s++) {
+        uint16_t votes[N_CLASSES] = {0};
+
+        for (int t = 0; t < slot->n_active; t++) {
+            const uint8_t *tile_votes = (const uint8_t *)&slot->buf[t][s * VOTE_WORDS];
+
+            for (int c = 0; c < N_CLASSES; c++)
+                votes[c] += tile_votes[c];
+        }
+        predictions[s] = vote_winner(votes);
+    }
+}
+
+// Host side of a processed burst, kept out of the accelerator thread
+void drain_inferences_hw(struct burst_slot *slot, uint8_t *predictions)
+{
+    esp_monitor_vals_t vals_diff;
+    union stamps u_stamps;
+
+    printf("  > Hardware test time: %f ms\n", slot->exe_time_ms);
+
+    vals_diff = esp_monitor_diff(slot->vals_start, slot->vals_end);
     FILE *fp = fopen("Trees_esp_mon_all.txt", "w");
     esp_monitor_print(mon_args, vals_diff, fp);
     fclose(fp);
 
-    memcpy(predictions, buf, read_samples);
+    if (slot->votes)
+        reduce_votes(slot, predictions);
 
-    memcpy(&u_stamps.data, &buf[read_samples/8], sizeof(uint64_t));
-    printf(" - Process features clock stamps: send %i, process %i clk cicles\n", u_stamps.clk[1], u_stamps.clk[0]);
+    for (int t = 0; t < slot->n_active; t++) {
+        token_t *buf = slot->buf[t];
+        int stamps_word = slot->votes ? slot->tile_burst[t] * VOTE_WORDS : slot->tile_burst[t]/8;
 
+        if (!slot->votes)
+            memcpy(&predictions[t * MAX_BURST], buf, slot->tile_burst[t]);
+
+        memcpy(&u_stamps.data, &buf[stamps_word], sizeof(uint64_t));
+        printf(" - Process features clock stamps tile %i: send %i, process %i clk cicles\n", t,
+                u_stamps.clk[1], u_stamps.clk[0]);
+    }
 }
 
-void print_accuracy(struct feature *features, uint8_t *predictions, 
-                        int read_samples, int n_classes)
+/*
+ * Accelerator thread: runs the slots in ring order as soon as the host marks
+ * them ready, so a new burst starts as soon as the previous one ends.
+ */
+static void *accelerator_worker(void *arg)
 {
+    struct burst_pipeline *pipeline = arg;
 
-    int accuracy[256]   = {0};
-    int accuracy_total  = 0;
-    int evaluated[256]  = {0};
-    int evaluated_total = 0;
+    for (int i = 0; ; i = (i + 1) % pipeline->depth) {
+        struct burst_slot *slot = &pipeline->slots[i];
 
-    for (size_t i = 0; i < read_samples/8; i++) {
-        for (size_t k = 0; k < 8; k++){
+        pthread_mutex_lock(&pipeline->lock);
+        while (slot->state != SLOT_READY && !pipeline->finished)
+            pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+        pthread_mutex_unlock(&pipeline->lock);
 
-            if (features[i*8+k].prediction == predictions[i*8+k]) {
-                accuracy[features[i*8+k].prediction]++;
-                accuracy_total++;
-            }
-            evaluated[features[i*8+k].prediction]++;
-            evaluated_total++;
-        }
-    }
+        // Bursts are submitted in ring order, past the last one no slot is ready
+        if (slot->state != SLOT_READY)
+            break;
+
+        perform_inferences_hw(slot);
 
-    for (int i = 0; i <= n_classes; i++) {
-        printf("Accuracy %f class %i num instances %i\n", 1.0 * accuracy[i] / evaluated[i], i,
-               evaluated[i]);
+        pthread_mutex_lock(&pipeline->lock);
+        slot->state = SLOT_DONE;
+        pthread_cond_broadcast(&pipeline->changed);
+        pthread_mutex_unlock(&pipeline->lock);
     }
 
-    printf("Accuracy total %f evaluates samples %i of %i\n", 1.0 * accuracy_total / read_samples,
-           evaluated_total, read_samples);
+    return NULL;
 }
 
-void evaluate_model(token_t *trees_buf, token_t *features_buf[MAX_BURST],  struct feature *features, int read_samples, int n_classes,
-                    uint8_t *predictions, uint32_t max_burst, float *exe_time_ms)
+static void set_slot_state(struct burst_pipeline *pipeline, struct burst_slot *slot,
+                            enum slot_state state)
 {
-    uint32_t processed = 0;
-    uint32_t burst, burst_i=0;
-    float exe_t;
-    *exe_time_ms = 0;
-
-    send_trees(trees_buf);
-
-    while (processed < read_samples) {
-        burst =
-            (read_samples - processed) > max_burst ? max_burst : (read_samples - processed);
-        printf("Processing batch %i, processed %i of %i\n", burst, processed, read_samples);
-        perform_inferences_hw(features_buf[burst_i],
-                                burst, &predictions[processed], &exe_t);
-        *exe_time_ms += exe_t;
-        processed += burst;
-        burst_i++;
-    }
-
-    print_accuracy(features, predictions, read_samples, n_classes);
+    pthread_mutex_lock(&pipeline->lock);
+    slot->state = state;
+    pthread_cond_broadcast(&pipeline->changed);
+    pthread_mutex_unlock(&pipeline->lock);
 }
 
-void make_prediction(token_t *tree, float features[N_FEATURE], int32_t *prediction)
+struct accuracy_counts {
+    int accuracy[256];
+    int evaluated[256];
+    int accuracy_total;
+    int evaluated_total;
+    int n_classes;
+};
+
+void add_accuracy(struct accuracy_counts *counts, const uint8_t *labels,
+                    const uint8_t *predictions, int n_samples)
 {
-    int32_t leaf_value;
-    int32_t counts[N_CLASSES] = {0};
-
-    for (int t = 0; t < N_TREES; t++) {
-        uint8_t node_index = 0;
-        uint8_t node_right;
-        uint8_t node_left;
-        uint8_t feature_index;
-        float threshold;
-        tree_data tree_data;
-
-        while (1) {
-            tree_data.compact_data = tree[t * N_NODE_AND_LEAFS + node_index];
-            feature_index          = tree_data.tree_camps.feature_index;
-            threshold              = tree_data.tree_camps.float_int_union.f;
-            node_left              = node_index + 1;
-            node_right             = tree_data.tree_camps.next_node_right_index;
-
-            node_index = *(int32_t *)&features[feature_index] < *(int32_t *)&threshold ? node_left :
-                                                                                         node_right;
-
-            if (!(tree_data.tree_camps.leaf_or_node & 0x01)) break;
+    for (int i = 0; i < n_samples; i++) {
+        if (labels[i] == predictions[i]) {
+            counts->accuracy[labels[i]]++;
+            counts->accuracy_total++;
         }
-
-        leaf_value = tree_data.tree_camps.float_int_union.i;
-        if (leaf_value >= 0 && leaf_value < N_CLASSES) { counts[leaf_value]++; }
+        counts->evaluated[labels[i]]++;
+        counts->evaluated_total++;
+        if (counts->n_classes < labels[i]) { counts->n_classes = labels[i]; }
     }
+}
 
-    // Busca la clase ganadora
-    int32_t best       = 0;
-    int32_t best_count = counts[0];
-
-    for (int c = 1; c < N_CLASSES; c++) {
-        if (counts[c] > best_count) {
-            best_count = counts[c];
-            best       = c;
-        }
+void print_accuracy(const struct accuracy_counts *counts)
+{
+    for (int i = 0; i <= counts->n_classes; i++) {
+        printf("Accuracy %f class %i num instances %i\n",
+               1.0 * counts->accuracy[i] / counts->evaluated[i], i, counts->evaluated[i]);
     }
 
-    *prediction = best;
+    printf("Accuracy total %f evaluates samples %i\n",
+           1.0 * counts->accuracy_total / counts->evaluated_total, counts->evaluated_total);
 }
 
-void software_prediction(struct feature *features, int read_samples,
-                            token_t* tree, int n_classes, uint8_t *predictions_sw, 
-                            float *exe_time_ms)
+/*
+ * Software reference for a burst: the compiled model when one is loaded,
+ * make_prediction() on every sample otherwise.
+ */
+float software_prediction(const float *features, int n_samples, const tree_data *tree,
+                            int n_trees, uint8_t *predictions_sw, int n_threads,
+                            compiled_predict_t compiled)
 {
-    int32_t prediction;
-    int accuracy[256]   = {0};
-    int accuracy_total  = 0;
-    int evaluated[256]  = {0};
-    int evaluated_total = 0;
     struct timespec startn, endn;
-    unsigned long long sw_ns;
 
     gettime(&startn);
-    for (size_t i = 0; i < read_samples; i++) {
-        make_prediction(tree, features[i].features, &prediction);
-        if (features[i].prediction == prediction) {
-            accuracy[features[i].prediction]++;
-            accuracy_total++;
-        }
-        predictions_sw[i] = prediction;
-        
-
-        evaluated[features[i].prediction]++;
-        evaluated_total++;
-    }
+    if (compiled)
+        predict_compiled_parallel(compiled, features, N_FEATURE, n_samples, predictions_sw,
+                        n_threads);
+    else
+        predict_scalar_parallel(tree, n_trees, features, N_FEATURE, n_samples, predictions_sw,
+                        n_threads);
     gettime(&endn);
-    sw_ns = ts_subtract(&startn, &endn);
-    *exe_time_ms = sw_ns/1000000.0;
-    printf("  > Software test time: %f ms\n", *exe_time_ms);
-
-    for (int i = 0; i <= n_classes; i++) {
-        printf("Accuracy %f class %i num instances %i\n", 1.0 * accuracy[i] / evaluated[i], i,
-               evaluated[i]);
-    }
 
-    printf("Accuracy total %f evaluates samples %i of %i\n", 1.0 * accuracy_total / read_samples,
-           evaluated_total, read_samples);
+    return ts_subtract(&startn, &endn) / 1000000.0;
 }
 
-void find_n_classes(struct feature features[MAX_TEST_SAMPLES], int *n_classes, int read_samples)
+int get_mismatchs(const uint8_t *predictions_hw, const uint8_t *predictions_sw, int n_samples,
+                    int first_sample)
 {
+    int mismatchs = 0;
 
-    *n_classes = features[0].prediction;
-
-    for (int i = 1; i < read_samples; i++) {
-        if (*n_classes < features[i].prediction) { *n_classes = features[i].prediction; }
+    for (int i = 0; i < n_samples; i++){
+        if (predictions_hw[i] != predictions_sw[i]){
+            mismatchs++;
+            printf("Error %i predictions_hw,%i != predictions_sw,%i\n", first_sample + i,
+                    predictions_hw[i], predictions_sw[i]);
+        }
     }
+
+    return mismatchs;
 }
 
-void get_mismatchs(uint8_t *predictions_hw, uint8_t *predictions_sw, int read_samples)
+/*
+ * Streams the dataset through a ring of depth rounds of n_tiles DMA buffers
+ * of MAX_BURST samples, so memory use does not depend on the size of the
+ * file. Consecutive bursts of a round go to different tiles, which run
+ * concurrently. When the model is split in n_groups > 1 groups of trees,
+ * one per tile, a round is a single burst copied to every tile and the
+ * per-class votes of the tiles are reduced on the host. A worker thread
+ * feeds the accelerators while the host parses and scores round N+1 and
+ * drains round N-1; with depth 1 every round is run synchronously. The
+ * software engine runs on each burst before it is handed to the accelerator,
+ * which writes its predictions over the first features of the buffer.
+ */
+int evaluate_stream(struct dataset_stream *stream, token_t *trees_bufs[],
+                    token_t *features_buf[][MAX_TILES], int depth, int n_tiles, int n_groups,
+                    const tree_data *sw_tree, int n_threads, compiled_predict_t compiled)
 {
-
+    static struct burst_pipeline pipeline;
+    struct accuracy_counts counts_hw = {0};
+    struct accuracy_counts counts_sw = {0};
+    uint8_t predictions_hw[MAX_TILES * MAX_BURST];
+    float exe_time_ms_sw = 0;
+    float exe_time_ms_hw = 0;
+    int submitted = 0;
+    int processed = 0;
     int mismatchs = 0;
+    int fill = 0, drain = 0, in_flight = 0;
+    int end_of_data = 0;
+    pthread_t worker;
+    struct timespec startn, endn;
 
-    for (int i = 0; i < read_samples; i++){
-        if (predictions_hw[i] != predictions_sw[i]){
-            mismatchs++;
-            printf("Error %i predictions_hw,%i != predictions_sw,%i\n", i, predictions_hw[i], predictions_sw[i]);
+    send_trees(trees_bufs, n_tiles);
+
+    memset(&pipeline, 0, sizeof(pipeline));
+    pipeline.depth = depth;
+    for (int i = 0; i < depth; i++)
+        memcpy(pipeline.slots[i].buf, features_buf[i], sizeof(token_t *) * n_tiles);
+    pthread_mutex_init(&pipeline.lock, NULL);
+    pthread_cond_init(&pipeline.changed, NULL);
+
+    gettime(&startn);
+    pthread_create(&worker, NULL, accelerator_worker, &pipeline);
+
+    while (!end_of_data || in_flight) {
+        struct burst_slot *slot;
+
+        // Keep the ring full while there is data, the oldest slot is free to refill
+        if (!end_of_data && in_flight < depth) {
+            slot = &pipeline.slots[fill];
+            slot->burst = 0;
+            slot->n_active = 0;
+            slot->votes = n_groups > 1;
+            for (int t = 0; t < n_tiles && !slot->votes; t++) {
+                float *features = (float *)slot->buf[t];
+                int burst = read_features_chunk(stream, MAX_BURST, features,
+                                                &slot->labels[t * MAX_BURST]);
+                if (burst == 0)
+                    break;
+
+                exe_time_ms_sw += software_prediction(features, burst, sw_tree,
+                                                        n_groups * N_TREES,
+                                                        &slot->predictions_sw[t * MAX_BURST],
+                                                        n_threads, compiled);
+                slot->tile_burst[t] = burst;
+                slot->burst += burst;
+                slot->n_active++;
+                if (burst < MAX_BURST)
+                    break;
+            }
+
+            if (slot->votes) {
+                float *features = (float *)slot->buf[0];
+
+                slot->burst = read_features_chunk(stream, MAX_BURST, features, slot->labels);
+                if (slot->burst) {
+                    exe_time_ms_sw += software_prediction(features, slot->burst, sw_tree,
+                                                            n_groups * N_TREES,
+                                                            slot->predictions_sw, n_threads,
+                                                            compiled);
+                    for (int t = 0; t < n_tiles; t++) {
+                        if (t)
+                            memcpy(slot->buf[t], features,
+                                    sizeof(float) * N_FEATURE * slot->burst);
+                        slot->tile_burst[t] = slot->burst;
+                    }
+                    slot->n_active = n_tiles;
+                }
+            }
+
+            if (slot->burst == 0) {
+                end_of_data = 1;
+                pthread_mutex_lock(&pipeline.lock);
+                pipeline.finished = 1;
+                pthread_cond_broadcast(&pipeline.changed);
+                pthread_mutex_unlock(&pipeline.lock);
+                continue;
+            }
+
+            printf("Processing batch %i on %i tiles, processed %i\n", slot->burst,
+                    slot->n_active, submitted);
+            slot->first_sample = submitted;
+            set_slot_state(&pipeline, slot, SLOT_READY);
+
+            submitted += slot->burst;
+            fill = (fill + 1) % depth;
+            in_flight++;
+            continue;
         }
+
+        slot = &pipeline.slots[drain];
+        pthread_mutex_lock(&pipeline.lock);
+        while (slot->state != SLOT_DONE)
+            pthread_cond_wait(&pipeline.changed, &pipeline.lock);
+        pthread_mutex_unlock(&pipeline.lock);
+
+        drain_inferences_hw(slot, predictions_hw);
+        exe_time_ms_hw += slot->exe_time_ms;
+
+        add_accuracy(&counts_sw, slot->labels, slot->predictions_sw, slot->burst);
+        add_accuracy(&counts_hw, slot->labels, predictions_hw, slot->burst);
+        mismatchs += get_mismatchs(predictions_hw, slot->predictions_sw, slot->burst,
+                                    slot->first_sample);
+        processed += slot->burst;
+
+        set_slot_state(&pipeline, slot, SLOT_FREE);
+        drain = (drain + 1) % depth;
+        in_flight--;
+    }
+
+    pthread_join(worker, NULL);
+    gettime(&endn);
+
+    pthread_mutex_destroy(&pipeline.lock);
+    pthread_cond_destroy(&pipeline.changed);
+
+    if (processed == 0) {
+        printf("No samples read from the dataset\n");
+        return -1;
     }
 
+    printf("Streamed %i samples in %f ms on %i tiles with %i buffers each (%s parallel)\n",
+            processed, ts_subtract(&startn, &endn) / 1000000.0, n_tiles, depth,
+            n_groups > 1 ? "model" : "data");
+    printf("evaluate_model software\n");
+    printf("  > Software test time: %f ms on %i threads (%s)\n", exe_time_ms_sw, n_threads,
+            compiled ? "compiled" : "scalar");
+    print_accuracy(&counts_sw);
+    printf("evaluate_model hardware\n");
+    printf("  > Hardware test time: %f ms\n", exe_time_ms_hw);
+    print_accuracy(&counts_hw);
+
+    printf("Speed up hardware vs software (%i threads) %f\n", n_threads,
+            exe_time_ms_sw/exe_time_ms_hw);
     printf("Num mismatch %i\n", mismatchs);
+
+    return 0;
 }
 
 int main(int argc, char **argv)
 {
-    token_t *features_buf[MAX_TEST_SAMPLES/MAX_BURST];
-    token_t *tree_buf;
-    struct feature features_read[MAX_TEST_SAMPLES];
-    uint8_t predictions_sw[MAX_TEST_SAMPLES];
-    uint8_t predictions_hw[MAX_TEST_SAMPLES];
-    int n_classes;
-    int read_samples;
-    float exe_time_ms_hw;
-    float exe_time_ms_sw;
+    static token_t *features_buf[MAX_PIPELINE_DEPTH][MAX_TILES];
+    token_t *trees_bufs[MAX_TILES];
+    int depth = PIPELINE_DEPTH;
+    int n_tiles = 0;
+    int n_model_trees, n_groups;
+    tree_data *model;
+    struct dataset_stream stream;
+    int n_threads = omp_get_num_procs();
+    const char *compiled_file = NULL;
+    compiled_predict_t compiled = NULL;
+    int opt;
+    int ret;
+
+    while ((opt = getopt(argc, argv, "t:s:d:n:")) != -1) {
+        switch (opt) {
+        case 't':
+            n_threads = atoi(optarg);
+            break;
+        case 's':
+            compiled_file = optarg;
+            break;
+        case 'd':
+            depth = atoi(optarg);
+            break;
+        case 'n':
+            n_tiles = atoi(optarg);
+            break;
+        default:
+            printf("Use: %s [-t threads] [-s model.so] [-d buffers] [-n tiles] <dataset.csv|dataset.bin> <modelo.model>\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (n_threads < 1)
+        n_threads = 1;
+    if (depth < 1)
+        depth = 1;
+    if (depth > MAX_PIPELINE_DEPTH)
+        depth = MAX_PIPELINE_DEPTH;
+    // -n forces the tile count where the device nodes cannot be listed
+    if (n_tiles < 1)
+        n_tiles = discover_tiles(MAX_TILES);
+    if (n_tiles > MAX_TILES)
+        n_tiles = MAX_TILES;
 
     init_parameters();
-    for (int i = 0; i < MAX_TEST_SAMPLES/MAX_BURST; i++)
-        features_buf[i] = (token_t *)esp_alloc(MAX_BURST*N_FEATURE*(sizeof(float)));
-    tree_buf = (token_t *)esp_alloc(size);
+    for (int i = 0; i < depth; i++)
+        for (int t = 0; t < n_tiles; t++)
+            features_buf[i][t] = (token_t *)esp_alloc(MAX_BURST*N_FEATURE*(sizeof(float)));
+    for (int t = 0; t < n_tiles; t++)
+        trees_bufs[t] = (token_t *)esp_alloc(size);
 
     // Validación de los argumentos: se esperan dos argumentos (dataset y modelo)
-    if (argc < 3) {
-        printf("Use: %s <dataset.csv> <modelo.model>\n", argv[0]);
+    if (argc - optind < 2) {
+        printf("Use: %s [-t threads] [-s model.so] [-d buffers] [-n tiles] <dataset.csv|dataset.bin> <modelo.model>\n", argv[0]);
         return 1;
     }
 
-    printf("\nExecute ====== %s 2.0 ======\n\n", cfg_000[0].devname);
+    printf("\nExecute ====== %s 2.0 (%i tiles) ======\n\n", cfg_000[0].devname, n_tiles);
 
-    // Cargar dataset desde el archivo recibido por línea de comandos
-    printf("Cargando features desde %s...\n", argv[1]);
-    read_samples = read_n_features(argv[1], MAX_TEST_SAMPLES, features_read, features_buf);
-    if (read_samples < 0) {
+    // El dataset se lee por bloques durante la inferencia
+    if (open_dataset(argv[optind], &stream)) {
         return 1;
     }
 
-    find_n_classes(features_read, &n_classes, read_samples);
-    printf("Num clases of the dataset %i\n", n_classes);
-    printf("Num features_read from the dataset %i\n", read_samples);
-
     // Cargar modelo desde el archivo recibido por línea de comandos
-    printf("Cargando modelo desde %s...\n", argv[2]);
-    load_model(tree_buf, argv[2]);
-    
-    printf("evaluate_model software\n");
-    software_prediction(features_read, read_samples, tree_buf, n_classes, predictions_sw, &exe_time_ms_sw);
+    printf("Cargando modelo desde %s...\n", argv[optind + 1]);
+    model = load_model(argv[optind + 1], &n_model_trees);
+    if (model == NULL) {
+        return 1;
+    }
 
-    printf("evaluate_model hardware\n");
-    evaluate_model(tree_buf, features_buf, features_read, read_samples,
-                    n_classes, predictions_hw, MAX_BURST, &exe_time_ms_hw);
+    // Models larger than a tile are split in groups of N_TREES trees, one group per tile.
+    // The tiles must be built with VOTE_COUNTS=1 to return the per-class votes
+    n_groups = n_model_trees / N_TREES;
+    if (n_groups > n_tiles) {
+        printf("The model needs %i tiles of %i trees, only %i available\n", n_groups, N_TREES,
+                n_tiles);
+        return 1;
+    }
+    if (init_tiles(n_tiles, n_groups)) {
+        return 1;
+    }
+    if (n_groups > 1)
+        printf("Model split over %i of the %i tiles, %i trees each\n", n_groups, n_tiles,
+                N_TREES);
+
+    if (compiled_file) {
+        if (n_groups > 1) {
+            printf("Compiled models hold a single group of %i trees\n", N_TREES);
+            return 1;
+        }
+        compiled = load_compiled_model(compiled_file, model);
+        if (compiled == NULL) {
+            return 1;
+        }
+    }
 
-    printf("Speed up hardware vs software %f\n", exe_time_ms_sw/exe_time_ms_hw);
+    // send_trees() leaves its output in buf[0] and buf[1] of every tile, the software engine keeps the model
+    for (int t = 0; t < n_tiles; t++)
+        memcpy(trees_bufs[t], &model[(n_groups > 1 ? t : 0) * N_TREES * N_NODE_AND_LEAFS],
+                sizeof(tree_data) * N_TREES * N_NODE_AND_LEAFS);
 
-    get_mismatchs(predictions_hw, predictions_sw, read_samples);
+    printf("Cargando features desde %s...\n", argv[optind]);
+    ret = evaluate_stream(&stream, trees_bufs, features_buf, depth,
+                            n_groups > 1 ? n_groups : n_tiles, n_groups, model, n_threads,
+                            compiled);
 
-    for (int i = 0; i < MAX_TEST_SAMPLES/MAX_BURST; i++)
-        esp_free(features_buf[i]);
+    close_dataset(&stream);
+    free(model);
 
-    esp_free(tree_buf);
+    for (int i = 0; i < depth; i++)
+        for (int t = 0; t < n_tiles; t++)
+            esp_free(features_buf[i][t]);
 
-    return 0;
+    for (int t = 0; t < n_tiles; t++)
+        esp_free(trees_bufs[t]);
+
+    return ret ? 1 : 0;
 }
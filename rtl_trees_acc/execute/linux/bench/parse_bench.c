@@ -0,0 +1,171 @@
+/*
+ * Compares the strtok()/atof() row loader the apps used before with
+ * parse_row() on a dataset file. The file is read into memory once and both
+ * loaders go through fgets() on a memory stream, so the times only include
+ * splitting and converting the rows. The old loader only split on commas; it
+ * is given the same delimiters as parse_row() here so that it also reads the
+ * space separated .dat files and both results can be compared.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "inference.h"
+#include "parse.h"
+
+#define REPEATS 10
+#define DELIMITERS ", \t\r\n"
+
+typedef int (*loader_t)(FILE *file, float *features, uint8_t *labels, int n);
+
+static int load_strtok(FILE *file, float *features, uint8_t *labels, int n)
+{
+    char line[MAX_LINE_LENGTH];
+    int read_samples = 0;
+
+    while (read_samples < n && fgets(line, MAX_LINE_LENGTH, file)) {
+        float *row = &features[read_samples * N_FEATURE];
+        float temp[N_FEATURE + 1];
+        char *token = strtok(line, DELIMITERS);
+        int index = 0;
+        int i;
+
+        while (token != NULL && index < N_FEATURE + 1) {
+            temp[index] = atof(token);
+            token = strtok(NULL, DELIMITERS);
+            index++;
+        }
+
+        for (i = 0; i < index - 1; i++)
+            row[i] = temp[i];
+        for (; i < N_FEATURE; i++)
+            row[i] = 0;
+        labels[read_samples] = (uint8_t) temp[index - 1];
+
+        read_samples++;
+    }
+
+    return read_samples;
+}
+
+static int load_parse_row(FILE *file, float *features, uint8_t *labels, int n)
+{
+    char line[MAX_LINE_LENGTH];
+    int read_samples = 0;
+    float label;
+
+    while (read_samples < n && fgets(line, MAX_LINE_LENGTH, file)) {
+        float *row = &features[read_samples * N_FEATURE];
+        int n_values = parse_row(line, row, N_FEATURE, &label);
+        int i;
+
+        if (n_values < 1)
+            continue;
+
+        for (i = n_values; i < N_FEATURE; i++)
+            row[i] = 0;
+        labels[read_samples] = (uint8_t) label;
+
+        read_samples++;
+    }
+
+    return read_samples;
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+// Best time of REPEATS runs of a loader over the text in memory
+static double time_loader(loader_t loader, char *text, size_t length, float *features,
+                            uint8_t *labels, int n, int *read_samples)
+{
+    double best = 0;
+
+    for (int r = 0; r < REPEATS; r++) {
+        FILE *file = fmemopen(text, length, "r");
+        double start = now_ms();
+        double elapsed;
+
+        *read_samples = loader(file, features, labels, n);
+        elapsed = now_ms() - start;
+        fclose(file);
+
+        if (r == 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        printf("Use: %s <dataset> [dataset ...]\n", argv[0]);
+        return 1;
+    }
+
+    for (int a = 1; a < argc; a++) {
+        FILE *file = fopen(argv[a], "rb");
+        size_t length;
+        char *text;
+        int max_samples = 0;
+        int samples_old, samples_new;
+        float *features_old, *features_new;
+        uint8_t *labels_old, *labels_new;
+        double ms_old, ms_new;
+
+        if (file == NULL) {
+            printf("Error opening %s\n", argv[a]);
+            return 1;
+        }
+
+        fseek(file, 0, SEEK_END);
+        length = ftell(file);
+        rewind(file);
+        text = malloc(length + 1);
+        if (text == NULL || fread(text, 1, length, file) != length) {
+            printf("Error reading %s\n", argv[a]);
+            return 1;
+        }
+        fclose(file);
+        text[length] = 0;
+
+        for (size_t i = 0; i < length; i++)
+            max_samples += text[i] == '\n';
+        max_samples++;
+
+        features_old = malloc(sizeof(float) * N_FEATURE * max_samples);
+        features_new = malloc(sizeof(float) * N_FEATURE * max_samples);
+        labels_old   = malloc(max_samples);
+        labels_new   = malloc(max_samples);
+
+        ms_old = time_loader(load_strtok, text, length, features_old, labels_old,
+                                max_samples, &samples_old);
+        ms_new = time_loader(load_parse_row, text, length, features_new, labels_new,
+                                max_samples, &samples_new);
+
+        printf("%s: %d rows\n", argv[a], samples_new);
+        printf("  strtok/atof %10.3f ms\n", ms_old);
+        printf("  parse_row   %10.3f ms  (x%.2f)\n", ms_new, ms_old / ms_new);
+
+        if (samples_old != samples_new ||
+                memcmp(features_old, features_new, sizeof(float) * N_FEATURE * samples_new) ||
+                memcmp(labels_old, labels_new, samples_new))
+            printf("  results differ\n");
+        else
+            printf("  identical features and labels\n");
+
+        free(features_old);
+        free(features_new);
+        free(labels_old);
+        free(labels_new);
+        free(text);
+    }
+
+    return 0;
+}
@@ -0,0 +1,160 @@
+/*
+ * Turns a model.bin exported by the trainer into C code with one function
+ * per tree: every node becomes an if-else on a constant feature index and
+ * threshold, and every leaf a vote on a constant class. The result is built
+ * as a shared object that the execute app loads with -s, see Makefile.
+ */
+#include <inttypes.h>
+#include "inference.h"
+
+// Upper bound of nodes emitted per tree, only reached by malformed models
+#define MAX_EMITTED_NODES (16 * N_NODE_AND_LEAFS)
+
+static int emitted_nodes;
+
+int read_model(tree_data *tree, const char *filename)
+{
+    char magic_number[5] = {0};
+    FILE *file = fopen(filename, "rb");
+
+    if (file == NULL) {
+        printf("Error opening the model file %s\n", filename);
+        return -1;
+    }
+
+    if (fread(magic_number, 5, 1, file) != 1 || memcmp(magic_number, "model", 5)) {
+        printf("Unknown file type\n");
+        fclose(file);
+        return -1;
+    }
+
+    if (fread(tree, sizeof(tree_data), N_TREES * N_NODE_AND_LEAFS, file) !=
+            N_TREES * N_NODE_AND_LEAFS) {
+        printf("Model file %s is truncated\n", filename);
+        fclose(file);
+        return -1;
+    }
+
+    fclose(file);
+    return 0;
+}
+
+static void indent(FILE *out, int depth)
+{
+    fprintf(out, "%*s", 4 * (depth + 1), "");
+}
+
+static void emit_int32(FILE *out, int32_t value)
+{
+    if (value == INT32_MIN)
+        fprintf(out, "(-2147483647 - 1)");
+    else
+        fprintf(out, "%" PRId32, value);
+}
+
+/*
+ * Emits the subtree rooted at node_index following the same rules as
+ * make_prediction(): left child at node_index + 1 (8-bit wrap), right child
+ * at next_node_right_index, feature index modulo N_FEATURE and a signed
+ * compare of the float bits.
+ */
+static int emit_node(FILE *out, const tree_data *nodes, uint8_t node_index, int depth)
+{
+    struct tree_camps camps = nodes[node_index].tree_camps;
+
+    if (++emitted_nodes > MAX_EMITTED_NODES || depth > N_NODE_AND_LEAFS) {
+        return -1;
+    }
+
+    if (!(camps.leaf_or_node & 0x01)) {
+        int32_t leaf_value = camps.float_int_union.i;
+
+        indent(out, depth);
+        if (leaf_value >= 0 && leaf_value < N_CLASSES)
+            fprintf(out, "counts[%" PRId32 "]++;\n", leaf_value);
+        else
+            fprintf(out, "/* no vote */\n");
+        return 0;
+    }
+
+    indent(out, depth);
+    fprintf(out, "if (x[%d] < ", camps.feature_index % N_FEATURE);
+    emit_int32(out, camps.float_int_union.i);
+    fprintf(out, ") { /* %g */\n", camps.float_int_union.f);
+    if (emit_node(out, nodes, node_index + 1, depth + 1))
+        return -1;
+    indent(out, depth);
+    fprintf(out, "} else {\n");
+    if (emit_node(out, nodes, camps.next_node_right_index, depth + 1))
+        return -1;
+    indent(out, depth);
+    fprintf(out, "}\n");
+
+    return 0;
+}
+
+int emit_model(FILE *out, const tree_data *tree)
+{
+    fprintf(out, "/* Generated by trees_codegen, do not edit */\n");
+    fprintf(out, "#include <stddef.h>\n#include <stdint.h>\n#include <string.h>\n\n");
+    fprintf(out, "const int compiled_n_trees = %d;\n", N_TREES);
+    fprintf(out, "const uint64_t compiled_model_hash = 0x%016" PRIx64 "ULL;\n\n",
+            model_hash(tree));
+
+    for (int t = 0; t < N_TREES; t++) {
+        emitted_nodes = 0;
+        fprintf(out, "static inline void tree_%d(const int32_t *x, uint16_t *counts)\n{\n", t);
+        if (emit_node(out, &tree[t * N_NODE_AND_LEAFS], 0, 0)) {
+            printf("Tree %d is not a tree, it loops or shares subtrees\n", t);
+            return -1;
+        }
+        fprintf(out, "}\n\n");
+    }
+
+    fprintf(out, "void compiled_predict(const float *features, size_t stride,\n");
+    fprintf(out, "                      int n_samples, uint8_t *predictions)\n{\n");
+    fprintf(out, "    for (int s = 0; s < n_samples; s++) {\n");
+    fprintf(out, "        uint16_t counts[%d] = {0};\n", N_CLASSES);
+    fprintf(out, "        int32_t x[%d];\n", N_FEATURE);
+    fprintf(out, "        uint8_t best = 0;\n\n");
+    fprintf(out, "        memcpy(x, &features[s * stride], sizeof(x));\n");
+    for (int t = 0; t < N_TREES; t++)
+        fprintf(out, "        tree_%d(x, counts);\n", t);
+    fprintf(out, "\n        for (int c = 1; c < %d; c++) {\n", N_CLASSES);
+    fprintf(out, "            if (counts[c] > counts[best]) best = c;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "        predictions[s] = best;\n");
+    fprintf(out, "    }\n}\n");
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    static tree_data tree[N_TREES * N_NODE_AND_LEAFS];
+    FILE *out;
+
+    if (argc < 3) {
+        printf("Use: %s <model.bin> <model.c>\n", argv[0]);
+        return 1;
+    }
+
+    if (read_model(tree, argv[1]))
+        return 1;
+
+    out = fopen(argv[2], "w");
+    if (out == NULL) {
+        printf("Error opening the output file %s\n", argv[2]);
+        return 1;
+    }
+
+    if (emit_model(out, tree)) {
+        fclose(out);
+        remove(argv[2]);
+        return 1;
+    }
+
+    fclose(out);
+    printf("Generated %s from %s\n", argv[2], argv[1]);
+    return 0;
+}
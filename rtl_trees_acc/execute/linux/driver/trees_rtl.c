@@ -13,6 +13,9 @@
 #define DRV_NAME "trees_rtl"
 
 /* <<--regs-->> */
+#define TREES_TREE_COUNT_REG 0x50
+#define TREES_TREE_OFFSET_REG 0x4c
+#define TREES_VOTE_COUNTS_REG 0x48
 #define TREES_BURST_LEN_REG 0x44
 #define TREES_LOAD_TREES_REG 0x40
 
@@ -47,6 +50,9 @@ static void trees_prep_xfer(struct esp_device *esp, void *arg)
     struct trees_rtl_access *a = arg;
 
     /* <<--regs-config-->> */
+	iowrite32be(a->tree_count, esp->iomem + TREES_TREE_COUNT_REG);
+	iowrite32be(a->tree_offset, esp->iomem + TREES_TREE_OFFSET_REG);
+	iowrite32be(a->vote_counts, esp->iomem + TREES_VOTE_COUNTS_REG);
 	iowrite32be(a->burst_len, esp->iomem + TREES_BURST_LEN_REG);
 	iowrite32be(a->load_trees, esp->iomem + TREES_LOAD_TREES_REG);
     iowrite32be(a->src_offset, esp->iomem + SRC_OFFSET_REG);
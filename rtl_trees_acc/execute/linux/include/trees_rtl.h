@@ -20,6 +20,9 @@
 struct trees_rtl_access {
     struct esp_access esp;
     /* <<--regs-->> */
+	unsigned tree_count;
+	unsigned tree_offset;
+	unsigned vote_counts;
 	unsigned burst_len;
 	unsigned load_trees;
     unsigned src_offset;
@@ -0,0 +1,94 @@
+/*
+ * Converts a CSV or space separated dataset into the packed format of
+ * app/packed.h, so that the execute and train apps map it instead of parsing
+ * text on every run. The rows are parsed a burst at a time and only the
+ * labels are kept in memory until the end.
+ */
+#include "inference.h"
+#include "parse.h"
+#include "packed.h"
+
+int main(int argc, char **argv)
+{
+    static float features[MAX_BURST * N_FEATURE];
+    char line[MAX_LINE_LENGTH];
+    uint8_t *labels = NULL;
+    uint32_t capacity = 0;
+    uint32_t n_samples = 0;
+    uint32_t n_columns = 0;
+    int burst = 0;
+    FILE *in, *out;
+    float label;
+
+    if (argc < 3) {
+        printf("Use: %s <dataset.csv> <dataset.bin>\n", argv[0]);
+        return 1;
+    }
+
+    in = fopen(argv[1], "r");
+    if (in == NULL) {
+        printf("Failed to open the features file %s\n", argv[1]);
+        return 1;
+    }
+
+    out = fopen(argv[2], "wb");
+    if (out == NULL) {
+        printf("Error opening the output file %s\n", argv[2]);
+        return 1;
+    }
+
+    // The sample count is only known at the end, the header is written again then
+    write_packed_header(out, 0, N_FEATURE, 0);
+
+    while (1) {
+        int eof = fgets(line, MAX_LINE_LENGTH, in) == NULL;
+
+        if (!eof) {
+            float *row = &features[burst * N_FEATURE];
+            int n_values = parse_row(line, row, N_FEATURE, &label);
+
+            if (n_values < 1)
+                continue;
+
+            for (int i = n_values; i < N_FEATURE; i++)
+                row[i] = 0;
+            if (n_columns < n_values)
+                n_columns = n_values;
+
+            if (n_samples == capacity) {
+                capacity = capacity ? 2 * capacity : MAX_BURST;
+                labels = realloc(labels, capacity);
+                if (labels == NULL) {
+                    printf("Out of memory\n");
+                    return 1;
+                }
+            }
+            labels[n_samples++] = (uint8_t) label;
+            burst++;
+        }
+
+        if (burst == MAX_BURST || (eof && burst)) {
+            if (write_packed_features(out, features, burst * N_FEATURE)) {
+                printf("Error writing %s\n", argv[2]);
+                return 1;
+            }
+            burst = 0;
+        }
+
+        if (eof)
+            break;
+    }
+
+    if (fwrite(labels, 1, n_samples, out) != n_samples || fseek(out, 0, SEEK_SET) ||
+            write_packed_header(out, n_samples, N_FEATURE, n_columns)) {
+        printf("Error writing %s\n", argv[2]);
+        return 1;
+    }
+
+    fclose(in);
+    fclose(out);
+    free(labels);
+    printf("Packed %u samples of %u features from %s into %s\n", n_samples, n_columns,
+            argv[1], argv[2]);
+    return 0;
+}
@@ -10,6 +10,13 @@ module tb_esp_trees;
     parameter N_FEATURE        					= 32;
     parameter N_CLASES        					= 5;
     parameter MAX_BURST        					= 5000;
+    parameter VOTE_COUNTS      					= 1;    // the test checks the per-class vote mode
+    parameter N_INFLIGHT       					= 2;    // samples each tree engine walks at once
+    parameter ARGMAX           					= 1;    // vote argmax: 0 scan, 1 comparator tree, 2 pipelined tree
+    parameter DUAL_PORT        					= 0;    // two tree engines per BRAM, one per read port (even N_INFLIGHT)
+    parameter EARLY_EXIT       					= 0;    // stop counting once the winner is fixed (ARGMAX = 1)
+
+    parameter BURST_SEED       					= 1;    // seed of the burst sizes, same split on every design
 
     parameter N_SAMPLES = 10000;    // Number of samples
     parameter COLUMNAS = 33;        // 32 features + 1 label
@@ -17,6 +24,7 @@ module tb_esp_trees;
     parameter N_64_FEATURES = N_SAMPLES/2*(COLUMNAS-1);
 
     bit [63:0] trees            [N_TREES*N_NODES-1:0];
+    bit [63:0] trees_padded     [N_TREES*N_NODES-1:0];
     bit [63:0] features_mem_64  [N_64_FEATURES-1:0];
     bit [31:0] labels_mem       [N_SAMPLES-1:0];
     bit [31:0] predictions      [N_SAMPLES-1:0];
@@ -32,12 +40,20 @@ module tb_esp_trees;
 	    .N_NODE_AND_LEAFS(N_NODES),
 	    .N_FEATURE(N_FEATURE),
 	    .N_CLASES(N_CLASES),
-	    .MAX_BURST(MAX_BURST)
+	    .MAX_BURST(MAX_BURST),
+	    .VOTE_COUNTS(VOTE_COUNTS),
+	    .N_INFLIGHT(N_INFLIGHT),
+	    .ARGMAX(ARGMAX),
+	    .DUAL_PORT(DUAL_PORT),
+	    .EARLY_EXIT(EARLY_EXIT)
     )trees_rtl_basic_dma64_inst(
         .clk(esp_acc_if_inst.clk),
         .rst(esp_acc_if_inst.rst),
         .conf_info_load_trees(esp_acc_if_inst.conf_info_load_trees),
         .conf_info_burst_len(esp_acc_if_inst.conf_info_burst_len),
+        .conf_info_vote_counts(esp_acc_if_inst.conf_info_vote_counts),
+        .conf_info_tree_offset(esp_acc_if_inst.conf_info_tree_offset),
+        .conf_info_tree_count(esp_acc_if_inst.conf_info_tree_count),
         .conf_done(esp_acc_if_inst.conf_done),
         .acc_done(esp_acc_if_inst.acc_done),
         .dma_read_ctrl_ready(esp_acc_if_inst.dma_read_ctrl_ready),
@@ -156,6 +172,8 @@ module tb_esp_trees;
         int offset_processed;
         int samples_2_process;
         int load_length;
+        // The process cycles per sample depend on the burst sizes
+        process::self().srandom(BURST_SEED);
         @(posedge esp_acc_if_inst.rst);
         agent_esp_acc_inst.gold_gen(
             trees,
@@ -185,6 +203,11 @@ module tb_esp_trees;
 
         agent_esp_acc_inst.run(0, 0);   // TEST reprocessing with no more data
         agent_esp_acc_inst.run(0, 0);   // TEST reprocessing with no more data
+        agent_esp_acc_inst.run(0, 0, 1);    // TEST per-class votes of the resident burst
+        // TEST reloading a slice of the trees, in place, over the resident ones
+        agent_esp_acc_inst.load_memory(0, N_TREES*N_NODES, 0, trees);
+        agent_esp_acc_inst.run(1, 0, 0, N_TREES/4, N_TREES/4);
+        agent_esp_acc_inst.run(0, 0, 1);
         agent_esp_acc_inst.print_metrics(labels_mem);
         agent_esp_acc_inst.reset(); // Reset the agent for next processing
 
@@ -215,6 +238,21 @@ module tb_esp_trees;
 
         agent_esp_acc_inst.print_metrics(labels_mem);
 
+        // TEST a padded slice: load_model() pads split models with trees whose
+        // root is a -1 leaf, they must not vote for any class
+        trees_padded = trees;
+        for (int t = 3*N_TREES/4; t < N_TREES; t++)
+            trees_padded[t*N_NODES] = {32'hffffffff, 32'd0};
+        agent_esp_acc_inst.gold_gen(
+            trees_padded,
+            COLUMNAS-1,
+            features_mem_64,
+            labels_mem
+        );
+        agent_esp_acc_inst.load_memory(0, N_TREES*N_NODES, 0, trees_padded);
+        agent_esp_acc_inst.run(1, 0, 0, 3*N_TREES/4, N_TREES/4);
+        agent_esp_acc_inst.run(0, 0, 1);
+
         $stop;
 
     end
@@ -9,10 +9,16 @@
 typedef int64_t token_t;
 
 /* <<--params-def-->> */
+#define TREE_COUNT 0
+#define TREE_OFFSET 0
+#define VOTE_COUNTS 0
 #define BURST_LEN 128
 #define LOAD_TREES 0
 
 /* <<--params-->> */
+const int32_t tree_count = TREE_COUNT;
+const int32_t tree_offset = TREE_OFFSET;
+const int32_t vote_counts = VOTE_COUNTS;
 const int32_t burst_len = BURST_LEN;
 const int32_t load_trees = LOAD_TREES;
 
@@ -20,6 +26,9 @@ const int32_t load_trees = LOAD_TREES;
 
 struct trees_rtl_access trees_cfg_000[] = {{
     /* <<--descriptor-->> */
+		.tree_count = TREE_COUNT,
+		.tree_offset = TREE_OFFSET,
+		.vote_counts = VOTE_COUNTS,
 		.burst_len = BURST_LEN,
 		.load_trees = LOAD_TREES,
     .src_offset    = 0,
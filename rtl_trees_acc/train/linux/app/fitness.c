@@ -0,0 +1,375 @@
+#include "fitness.h"
+
+// Leaf reached by a sample, walked like the tree engines of the accelerator
+static int32_t walk_tree(const tree_t tree, const int32_t features[N_FEATURE])
+{
+    uint8_t node_index = 0;
+    tree_data node;
+
+    while (1) {
+        node = tree[node_index];
+        if (!(node.tree_camps.leaf_or_node & 0x01)) break;
+
+        node_index = features[node.tree_camps.feature_index % N_FEATURE] <
+                        node.tree_camps.float_int_union.i ? (uint8_t)(node_index + 1) :
+                                                            node.tree_camps.next_node_right_index;
+    }
+
+    return node.tree_camps.float_int_union.i;
+}
+
+static void add_votes(const tree_t *trees, int n_trees, const int32_t features[N_FEATURE],
+                        uint8_t votes[N_CLASSES])
+{
+    for (int t = 0; t < n_trees; t++) {
+        int32_t leaf_value = walk_tree(trees[t], features);
+        if (leaf_value >= 0 && leaf_value < N_CLASSES) { votes[leaf_value]++; }
+    }
+}
+
+// Class with the most votes, the lowest class on a tie like the accelerator
+static uint8_t vote_winner(const uint8_t votes[N_CLASSES])
+{
+    uint8_t best = 0;
+
+    for (int c = 1; c < N_CLASSES; c++) {
+        if (votes[c] > votes[best]) best = c;
+    }
+
+    return best;
+}
+
+static void feature_bits(const struct feature *feature, int32_t bits[N_FEATURE])
+{
+    memcpy(bits, feature->features, sizeof(int32_t) * N_FEATURE);
+}
+
+int cpu_fitness_init(struct cpu_fitness *fitness, int max_samples)
+{
+    fitness->capacity     = max_samples > 0 ? max_samples : 1;
+    fitness->n_samples    = 0;
+    fitness->features     = malloc(sizeof(*fitness->features) * fitness->capacity);
+    fitness->labels       = malloc(fitness->capacity);
+    fitness->frozen_votes = malloc(sizeof(*fitness->frozen_votes) * fitness->capacity);
+
+    if (fitness->features == NULL || fitness->labels == NULL || fitness->frozen_votes == NULL) {
+        cpu_fitness_free(fitness);
+        return -1;
+    }
+
+    return 0;
+}
+
+void cpu_fitness_free(struct cpu_fitness *fitness)
+{
+    free(fitness->features);
+    free(fitness->labels);
+    free(fitness->frozen_votes);
+    fitness->features     = NULL;
+    fitness->labels       = NULL;
+    fitness->frozen_votes = NULL;
+}
+
+/*
+ * Takes the samples to score and counts, once for the whole population, the
+ * votes of the frozen trees outside the stage boosting_i.
+ */
+void cpu_fitness_prepare(struct cpu_fitness *fitness, const tree_t *frozen, uint32_t boosting_i,
+                            const struct feature *features, int n_samples)
+{
+    const tree_t *stage = &frozen[boosting_i * N_BOOSTING];
+    const tree_t *after = &stage[N_BOOSTING];
+
+    fitness->n_samples = n_samples < fitness->capacity ? n_samples : fitness->capacity;
+
+    #pragma omp parallel for
+    for (int s = 0; s < fitness->n_samples; s++) {
+        feature_bits(&features[s], fitness->features[s]);
+        fitness->labels[s] = features[s].prediction;
+
+        memset(fitness->frozen_votes[s], 0, N_CLASSES);
+        add_votes(frozen, boosting_i * N_BOOSTING, fitness->features[s],
+                    fitness->frozen_votes[s]);
+        add_votes(after, N_TREES - (boosting_i + 1) * N_BOOSTING, fitness->features[s],
+                    fitness->frozen_votes[s]);
+    }
+}
+
+// Hits of the frozen trees plus the stage trees of an individual on the samples [begin, end)
+int cpu_fitness_range(const struct cpu_fitness *fitness, const tree_t trees[N_BOOSTING],
+                        int begin, int end)
+{
+    uint8_t votes[N_CLASSES];
+    int correct = 0;
+
+    for (int s = begin; s < end && s < fitness->n_samples; s++) {
+        memcpy(votes, fitness->frozen_votes[s], N_CLASSES);
+        add_votes(trees, N_BOOSTING, fitness->features[s], votes);
+        correct += vote_winner(votes) == fitness->labels[s];
+    }
+
+    return correct;
+}
+
+// Accuracy of the model made of the frozen trees and the stage trees of an individual
+float cpu_fitness_individual(const struct cpu_fitness *fitness, const tree_t trees[N_BOOSTING])
+{
+    if (fitness->n_samples == 0)
+        return 0;
+
+    return (float) cpu_fitness_range(fitness, trees, 0, fitness->n_samples) /
+            (float) fitness->n_samples;
+}
+
+void cpu_fitness_population(const struct cpu_fitness *fitness, struct population *population,
+                            const int *ranks, int n_ranks)
+{
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < n_ranks; i++) {
+        int p = ranks[i];
+        population->accuracy[p] = cpu_fitness_individual(fitness, individual(population, p));
+    }
+}
+
+#define LATENCY_ALPHA 0.25    // weight of the last measurement in the latency averages
+
+// Starts a generation, the latencies of the previous ones are kept
+void work_queue_reset(struct work_queue *queue, int n_items, int n_acc, int n_cpu)
+{
+    queue->next = 0;
+    queue->n_items = n_items;
+    queue->n_workers[WORKER_ACC] = n_acc;
+    queue->n_workers[WORKER_CPU] = n_cpu;
+    memset(queue->done, 0, sizeof(queue->done));
+}
+
+// Next item to evaluate by a worker of the given kind, -1 once it stops
+int work_queue_claim(struct work_queue *queue, enum worker_kind kind)
+{
+    int p = -1;
+
+    #pragma omp critical (work_queue)
+    {
+        double latency = queue->latency_ms[kind];
+        double rate = 0;
+        int fastest = 1;
+        int workers = 0;
+
+        for (int k = 0; k < N_WORKER_KINDS; k++) {
+            workers += queue->n_workers[k];
+            if (queue->n_workers[k] == 0 || queue->latency_ms[k] == 0)
+                continue;
+            rate += queue->n_workers[k] / queue->latency_ms[k];
+            if (queue->latency_ms[k] < latency)
+                fastest = 0;
+        }
+
+        // The fastest kind and the last worker always take work, so the queue is drained
+        if (queue->next < queue->n_items && (fastest || workers == 1 ||
+                latency * rate <= queue->n_items - queue->next))
+            p = queue->next++;
+        else
+            queue->n_workers[kind]--;
+    }
+
+    return p;
+}
+
+void work_queue_done(struct work_queue *queue, enum worker_kind kind, double ms)
+{
+    #pragma omp critical (work_queue)
+    {
+        double *latency = &queue->latency_ms[kind];
+
+        *latency = *latency > 0 ? *latency + LATENCY_ALPHA * (ms - *latency) : ms;
+        queue->done[kind]++;
+    }
+}
+
+// Only the given ranks race, the accuracy of the others is already known
+void race_start(struct race *race, int n_samples, const int *ranks, int n_ranks)
+{
+    race->n_samples = n_samples;
+    race->n_alive = n_ranks;
+    race->sample_evals = 0;
+    for (int p = 0; p < POPULATION; p++) {
+        race->correct[p] = 0;
+        race->scored[p] = 0;
+        race->known[p] = 1;
+    }
+    for (int i = 0; i < n_ranks; i++) {
+        race->alive[i] = ranks[i];
+        race->known[ranks[i]] = 0;
+    }
+}
+
+// End of the prefix scored in a round, the last round covers all the samples
+int race_prefix(const struct race *race, int round)
+{
+    return race->n_samples >> (RACE_ROUNDS - 1 - round);
+}
+
+// Safe to call from several threads for different ranks
+void race_score(struct race *race, int p, int correct, int n)
+{
+    race->correct[p] += correct;
+    race->scored[p] += n;
+
+    #pragma omp atomic
+    race->sample_evals += n;
+}
+
+static int compare_bound(const void *a, const void *b)
+{
+    float x = *(const float *)a;
+    float y = *(const float *)b;
+
+    return (x < y) - (x > y);
+}
+
+/*
+ * Updates the accuracy of the ranks still racing and drops the ones that
+ * cannot reach the elites. The bounds are Hoeffding's, which hold whatever
+ * the accuracy, even on the 0 and 1 estimates of the first prefixes.
+ */
+void race_prune(struct race *race, struct population *population)
+{
+    float lower[POPULATION];
+    float cutoff;
+    int n_lower = 0;
+    int n_alive = 0;
+
+    if (race->n_alive == 0)
+        return;
+
+    for (int i = 0; i < race->n_alive; i++) {
+        int p = race->alive[i];
+        float margin = sqrt(log(1 / RACE_DELTA) / (2.0 * race->scored[p]));
+
+        population->accuracy[p] = (float) race->correct[p] / (float) race->scored[p];
+        lower[n_lower++] = population->accuracy[p] - margin;
+    }
+
+    // The ranks that do not race count with their exact accuracy
+    for (int p = 0; p < POPULATION; p++) {
+        if (race->known[p])
+            lower[n_lower++] = population->accuracy[p];
+    }
+
+    if (n_lower <= POPULATION/4 || race->scored[race->alive[0]] >= race->n_samples)
+        return;
+
+    qsort(lower, n_lower, sizeof(float), compare_bound);
+    cutoff = lower[POPULATION/4 - 1];
+
+    for (int i = 0; i < race->n_alive; i++) {
+        int p = race->alive[i];
+        float margin = sqrt(log(1 / RACE_DELTA) / (2.0 * race->scored[p]));
+
+        if (population->accuracy[p] + margin >= cutoff)
+            race->alive[n_alive++] = p;
+    }
+    race->n_alive = n_alive;
+}
+
+// FNV-1a over the nodes of the stage trees of an individual
+uint64_t individual_hash(const tree_t trees[N_BOOSTING])
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (int t = 0; t < N_BOOSTING; t++) {
+        for (int n = 0; n < N_NODE_AND_LEAFS; n++) {
+            for (int b = 0; b < 64; b += 8) {
+                hash ^= (trees[t][n].compact_data >> b) & 0xff;
+                hash *= 0x100000001b3ULL;
+            }
+        }
+    }
+
+    return hash;
+}
+
+void fitness_cache_init(struct fitness_cache *cache)
+{
+    memset(cache, 0, sizeof(*cache));
+    cache->epoch = 1;
+}
+
+// The samples or the frozen trees changed, every entry is stale
+void fitness_cache_new_epoch(struct fitness_cache *cache)
+{
+    cache->epoch++;
+}
+
+/*
+ * Gives their cached accuracy to the individuals scored before with the
+ * same trees in this epoch and lists in ranks the ones left to score.
+ * Returns how many there are.
+ */
+int fitness_cache_lookup(struct fitness_cache *cache, struct population *population,
+                            int ranks[POPULATION])
+{
+    int hit[POPULATION];
+    int n_ranks = 0;
+
+    #pragma omp parallel for
+    for (int slot = 0; slot < POPULATION; slot++)
+        cache->hash[slot] = individual_hash(population->pool[slot]);
+
+    for (int p = 0; p < POPULATION; p++) {
+        uint64_t hash = cache->hash[population->rank[p]];
+
+        hit[p] = -1;
+        for (int slot = 0; slot < POPULATION; slot++) {
+            if (cache->scored_epoch[slot] == cache->epoch && cache->scored_hash[slot] == hash) {
+                hit[p] = slot;
+                break;
+            }
+        }
+    }
+
+    // Applied once all the ranks are looked up, storing overwrites entries
+    cache->hits = 0;
+    for (int p = 0; p < POPULATION; p++) {
+        if (hit[p] < 0) {
+            ranks[n_ranks++] = p;
+            continue;
+        }
+        population->accuracy[p] = cache->accuracy[hit[p]];
+        cache->hits++;
+    }
+    for (int p = 0; p < POPULATION; p++) {
+        if (hit[p] >= 0)
+            fitness_cache_store(cache, population, &p, 1);
+    }
+
+    return n_ranks;
+}
+
+// Records the accuracy of ranks scored on all the samples
+void fitness_cache_store(struct fitness_cache *cache, const struct population *population,
+                            const int *ranks, int n_ranks)
+{
+    for (int i = 0; i < n_ranks; i++) {
+        int slot = population->rank[ranks[i]];
+
+        cache->scored_hash[slot] = cache->hash[slot];
+        cache->scored_epoch[slot] = cache->epoch;
+        cache->accuracy[slot] = population->accuracy[ranks[i]];
+    }
+}
+
+// Predictions of the N_TREES trees of a model, the samples split over the threads
+void cpu_predict(const tree_t *trees, const struct feature *features, int n_samples,
+                    uint8_t *predictions)
+{
+    #pragma omp parallel for
+    for (int s = 0; s < n_samples; s++) {
+        int32_t bits[N_FEATURE];
+        uint8_t votes[N_CLASSES] = {0};
+
+        feature_bits(&features[s], bits);
+        add_votes(trees, N_TREES, bits, votes);
+        predictions[s] = vote_winner(votes);
+    }
+}
@@ -0,0 +1,131 @@
+#ifndef __FITNESS_H__
+#define __FITNESS_H__
+
+#include "train.h"
+
+// Where the accuracy of the individuals is measured
+enum fitness_backend {
+  FITNESS_ACC,    // trees_rtl accelerator, one individual after the other
+  FITNESS_CPU,    // host cores, several individuals in parallel
+  FITNESS_HYBRID  // accelerator and host cores fed from one work_queue
+};
+
+enum worker_kind {
+  WORKER_ACC,
+  WORKER_CPU,
+  N_WORKER_KINDS
+};
+
+/*
+ * Individuals, the ranks of the population or the ones still racing, handed
+ * out to the accelerator and to the CPU workers of the hybrid backend.
+ * Everybody takes the next rank while there is plenty of work; at the tail a
+ * kind of worker slower than the others stops once it would finish its
+ * individual after the rest drained the queue. latency_ms is a moving average
+ * over the generations, so the split follows the accelerator and the host
+ * load.
+ */
+struct work_queue {
+  int next;
+  int n_items;
+  int n_workers[N_WORKER_KINDS];      // workers still taking ranks
+  int done[N_WORKER_KINDS];
+  double latency_ms[N_WORKER_KINDS];  // per individual, 0 until measured
+};
+
+/*
+ * State of the CPU evaluator for one call of train_model(). The samples are
+ * kept as the raw bits of each float, since the accelerator compares the
+ * thresholds as signed integers, and frozen_votes holds the votes of the
+ * trees every individual shares, so only the N_BOOSTING trees of an
+ * individual are walked per sample. The threads only read it.
+ */
+struct cpu_fitness {
+  int32_t (*features)[N_FEATURE];
+  uint8_t *labels;
+  uint8_t (*frozen_votes)[N_CLASSES];
+  int n_samples;
+  int capacity;
+};
+
+/*
+ * Racing evaluation: the individuals are scored on RACE_ROUNDS growing
+ * prefixes of the samples, each twice the previous one. After every prefix
+ * the ones whose upper confidence bound falls below the elite cutoff, the
+ * POPULATION/4-th best lower bound, leave the race with the accuracy of
+ * their prefix. Only the survivors are scored on all the samples.
+ */
+#define RACE_ROUNDS 4
+#define RACE_DELTA 0.01   // chance of dropping an individual that is an elite
+
+struct race {
+  int n_samples;
+  int correct[POPULATION];  // per rank, hits on the samples scored so far
+  int scored[POPULATION];
+  int alive[POPULATION];    // ranks still racing
+  int n_alive;
+  uint8_t known[POPULATION];  // ranks not racing, their accuracy is exact
+  long sample_evals;        // samples scored in the generation, for the log
+};
+
+void race_start(struct race *race, int n_samples, const int *ranks, int n_ranks);
+
+int race_prefix(const struct race *race, int round);
+
+void race_score(struct race *race, int p, int correct, int n);
+
+void race_prune(struct race *race, struct population *population);
+
+/*
+ * Accuracy of the individuals already scored, one entry per slot of the
+ * population arena. An entry holds the hash of the N_BOOSTING trees it was
+ * scored with and the epoch of the samples and the frozen trees, so an
+ * unchanged elite, or a clone of it in another slot, is not scored again.
+ * Epoch 0 marks an empty entry.
+ */
+struct fitness_cache {
+  uint32_t epoch;
+  uint64_t hash[POPULATION];  // per slot, the trees it holds now
+  uint64_t scored_hash[POPULATION];
+  uint32_t scored_epoch[POPULATION];
+  float accuracy[POPULATION];
+  int hits;                   // of the last lookup
+};
+
+uint64_t individual_hash(const tree_t trees[N_BOOSTING]);
+
+void fitness_cache_init(struct fitness_cache *cache);
+
+void fitness_cache_new_epoch(struct fitness_cache *cache);
+
+int fitness_cache_lookup(struct fitness_cache *cache, struct population *population,
+                            int ranks[POPULATION]);
+
+void fitness_cache_store(struct fitness_cache *cache, const struct population *population,
+                            const int *ranks, int n_ranks);
+
+int cpu_fitness_init(struct cpu_fitness *fitness, int max_samples);
+
+void cpu_fitness_free(struct cpu_fitness *fitness);
+
+void cpu_fitness_prepare(struct cpu_fitness *fitness, const tree_t *frozen, uint32_t boosting_i,
+                            const struct feature *features, int n_samples);
+
+int cpu_fitness_range(const struct cpu_fitness *fitness, const tree_t trees[N_BOOSTING],
+                        int begin, int end);
+
+float cpu_fitness_individual(const struct cpu_fitness *fitness, const tree_t trees[N_BOOSTING]);
+
+void cpu_fitness_population(const struct cpu_fitness *fitness, struct population *population,
+                            const int *ranks, int n_ranks);
+
+void work_queue_reset(struct work_queue *queue, int n_items, int n_acc, int n_cpu);
+
+int work_queue_claim(struct work_queue *queue, enum worker_kind kind);
+
+void work_queue_done(struct work_queue *queue, enum worker_kind kind, double ms);
+
+void cpu_predict(const tree_t *trees, const struct feature *features, int n_samples,
+                    uint8_t *predictions);
+
+#endif // __FITNESS_H__
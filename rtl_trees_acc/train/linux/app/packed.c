@@ -0,0 +1,146 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "packed.h"
+
+// The file is little-endian, Leon3 hosts are not
+static uint32_t le32(uint32_t value)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_bswap32(value);
+#else
+    return value;
+#endif
+}
+
+int is_packed_dataset(const char *filename)
+{
+    char magic[8];
+    FILE *file = fopen(filename, "rb");
+    int packed;
+
+    if (file == NULL)
+        return 0;
+
+    packed = fread(magic, sizeof(magic), 1, file) == 1 && !memcmp(magic, PACKED_MAGIC, 8);
+    fclose(file);
+    return packed;
+}
+
+int map_packed_dataset(const char *filename, struct packed_dataset *dataset)
+{
+    const struct packed_header *header;
+    struct stat st;
+    int fd = open(filename, O_RDONLY);
+
+    if (fd < 0) {
+        printf("Failed to open the features file %s\n", filename);
+        return -1;
+    }
+
+    if (fstat(fd, &st) || st.st_size < PACKED_HEADER_SIZE) {
+        printf("%s is not a packed dataset\n", filename);
+        close(fd);
+        return -1;
+    }
+
+    dataset->map_size = st.st_size;
+    dataset->map = mmap(NULL, dataset->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (dataset->map == MAP_FAILED) {
+        printf("Failed to map %s\n", filename);
+        return -1;
+    }
+
+    header = dataset->map;
+    dataset->n_samples  = le32(header->n_samples);
+    dataset->n_features = le32(header->n_features);
+    dataset->n_columns  = le32(header->n_columns);
+
+    // Checked by dividing, the size of the body can wrap a 32-bit size_t
+    if (memcmp(header->magic, PACKED_MAGIC, 8) || dataset->n_features == 0 ||
+            dataset->n_features > (SIZE_MAX - 1) / sizeof(float) ||
+            dataset->n_samples > (dataset->map_size - PACKED_HEADER_SIZE) /
+                                    (dataset->n_features * sizeof(float) + 1)) {
+        printf("%s is not a packed dataset or is truncated\n", filename);
+        munmap(dataset->map, dataset->map_size);
+        return -1;
+    }
+
+    dataset->features = (const float *)((const uint8_t *)dataset->map + PACKED_HEADER_SIZE);
+    dataset->labels   = (const uint8_t *)&dataset->features[(size_t)dataset->n_samples *
+                                                            dataset->n_features];
+
+    // The data is read once front to back
+    madvise(dataset->map, dataset->map_size, MADV_SEQUENTIAL);
+
+    printf("Mapped %u samples of %u features from %s\n", dataset->n_samples,
+            dataset->n_features, filename);
+    return 0;
+}
+
+void unmap_packed_dataset(struct packed_dataset *dataset)
+{
+    munmap(dataset->map, dataset->map_size);
+}
+
+/*
+ * Copies n samples starting at first into rows of stride floats. The rows
+ * of the file are already in the layout of the feature bursts, so on a
+ * little-endian host this is one memcpy per sample.
+ */
+void copy_packed_samples(const struct packed_dataset *dataset, uint32_t first, uint32_t n,
+                            float *features, size_t stride, uint8_t *labels)
+{
+    size_t row_floats = dataset->n_features < stride ? dataset->n_features : stride;
+
+    for (uint32_t s = 0; s < n; s++) {
+        const float *src = &dataset->features[(size_t)(first + s) * dataset->n_features];
+        float *dst = &features[s * stride];
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        for (size_t f = 0; f < row_floats; f++) {
+            uint32_t word;
+
+            memcpy(&word, &src[f], sizeof(word));
+            word = le32(word);
+            memcpy(&dst[f], &word, sizeof(word));
+        }
+#else
+        memcpy(dst, src, row_floats * sizeof(float));
+#endif
+        memset(&dst[row_floats], 0, (stride - row_floats) * sizeof(float));
+    }
+
+    memcpy(labels, &dataset->labels[first], n);
+}
+
+int write_packed_header(FILE *file, uint32_t n_samples, uint32_t n_features, uint32_t n_columns)
+{
+    struct packed_header header = {0};
+
+    memcpy(header.magic, PACKED_MAGIC, 8);
+    header.n_samples  = le32(n_samples);
+    header.n_features = le32(n_features);
+    header.n_columns  = le32(n_columns);
+
+    return fwrite(&header, sizeof(header), 1, file) == 1 ? 0 : -1;
+}
+
+int write_packed_features(FILE *file, const float *features, size_t n_floats)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    for (size_t f = 0; f < n_floats; f++) {
+        uint32_t word;
+
+        memcpy(&word, &features[f], sizeof(word));
+        word = le32(word);
+        if (fwrite(&word, sizeof(word), 1, file) != 1)
+            return -1;
+    }
+    return 0;
+#else
+    return fwrite(features, sizeof(float), n_floats, file) == n_floats ? 0 : -1;
+#endif
+}
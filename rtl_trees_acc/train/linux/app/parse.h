@@ -0,0 +1,17 @@
+#ifndef __PARSE_H__
+#define __PARSE_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ * Locale independent parser for the dataset rows: numbers separated by any
+ * run of commas, spaces or tabs, the last number of the row being the label.
+ * Same copy in execute/ and train/.
+ */
+
+float parse_float(const char **cursor);
+
+int parse_row(const char *line, float *values, int max_values, float *label);
+
+#endif // __PARSE_H__
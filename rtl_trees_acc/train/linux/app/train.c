@@ -2,8 +2,38 @@
 
 uint8_t right_index[255] =  {128, 65, 34, 19, 12, 9, 8, 0, 0, 11, 0, 0, 16, 15, 0, 0, 18, 0, 0, 27, 24, 23, 0, 0, 26, 0, 0, 31, 30, 0, 0, 33, 0, 0, 50, 43, 40, 39, 0, 0, 42, 0, 0, 47, 46, 0, 0, 49, 0, 0, 58, 55, 54, 0, 0, 57, 0, 0, 62, 61, 0, 0, 64, 0, 0, 97, 82, 75, 72, 71, 0, 0, 74, 0, 0, 79, 78, 0, 0, 81, 0, 0, 90, 87, 86, 0, 0, 89, 0, 0, 94, 93, 0, 0, 96, 0, 0, 113, 106, 103, 102, 0, 0, 105, 0, 0, 110, 109, 0, 0, 112, 0, 0, 121, 118, 117, 0, 0, 120, 0, 0, 125, 124, 0, 0, 127, 0, 0, 192, 161, 146, 139, 136, 135, 0, 0, 138, 0, 0, 143, 142, 0, 0, 145, 0, 0, 154, 151, 150, 0, 0, 153, 0, 0, 158, 157, 0, 0, 160, 0, 0, 177, 170, 167, 166, 0, 0, 169, 0, 0, 174, 173, 0, 0, 176, 0, 0, 185, 182, 181, 0, 0, 184, 0, 0, 189, 188, 0, 0, 191, 0, 0, 224, 209, 202, 199, 198, 0, 0, 201, 0, 0, 206, 205, 0, 0, 208, 0, 0, 217, 214, 213, 0, 0, 216, 0, 0, 221, 220, 0, 0, 223, 0, 0, 240, 233, 230, 229, 0, 0, 232, 0, 0, 237, 236, 0, 0, 239, 0, 0, 248, 245, 244, 0, 0, 247, 0, 0, 252, 251, 0, 0, 254, 0, 0};
 
-float generate_random_float(float min, float max, int* seed) {
-    float random = (float)rand_r(seed) / RAND_MAX;
+static uint64_t splitmix64(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// PCG32 seeding: the stream selects one of 2^63 independent sequences
+void rng_init(struct rng *rng, uint64_t seed, uint64_t stream)
+{
+    rng->state = 0;
+    rng->inc   = (splitmix64(stream) << 1) | 1;
+    rng_next(rng);
+    rng->state += seed;
+    rng_next(rng);
+}
+
+/*
+ * Every individual draws from its own stream, derived from the seed of the
+ * run, the generation and the operator, so the result of a generation does
+ * not depend on how the individuals are spread over the threads.
+ */
+void individual_rng(struct rng *rng, const struct population *population,
+                    enum rng_stream op, uint32_t p)
+{
+    rng_init(rng, population->seed,
+                ((uint64_t)population->generation << 32) | ((uint64_t)op << 24) | p);
+}
+
+float generate_random_float(float min, float max, struct rng *rng) {
+    float random = (float)rng_rand(rng) / RNG_MAX;
 
     float distance = max - min;
     float step = distance * 0.01; // 1% de la distancia
@@ -11,25 +41,25 @@ float generate_random_float(float min, float max, int* seed) {
     return min + round(random * (distance / step)) * step; // Multiplicamos por step para ajustar el paso
 }
 
-float generate_random_float_0_1(int* seed) {
-    int boolean = (rand_r(seed) % 2);
+float generate_random_float_0_1(struct rng *rng) {
+    int boolean = (rng_rand(rng) % 2);
 
     return (float)boolean;
 }
 
-float generate_threshold(float min, float max,int* seed) {
+float generate_threshold(float min, float max, struct rng *rng) {
     float random_threshold;
 
     if(min == 0 && max == 1){
-        random_threshold = generate_random_float_0_1(seed);
+        random_threshold = generate_random_float_0_1(rng);
     }else{
-        random_threshold = generate_random_float(min, max, seed);
+        random_threshold = generate_random_float(min, max, rng);
     }
 
     return random_threshold;
 }
 
-float generate_leaf_value(int *seed,
+float generate_leaf_value(struct rng *rng,
                           int   n_classes,           // N en tu caso (clases 0…N)
                           const float *class_accuracy)
 {
@@ -40,7 +70,7 @@ float generate_leaf_value(int *seed,
     float const_term = (1.0f - beta * 0.5f) / (float)K;
 
     // Probabilidad de no votar = 25%
-    if ((rand_r(seed) & 0x3) == 0) {
+    if ((rng_rand(rng) & 0x3) == 0) {
         return NULL_VOTE;
     }
 
@@ -59,7 +89,7 @@ float generate_leaf_value(int *seed,
     }
 
     // 3) Muestreo ponderado sobre [0..total_w)
-    float r = ((float)rand_r(seed) / (float)RAND_MAX) * total_w;
+    float r = ((float)rng_rand(rng) / (float)RNG_MAX) * total_w;
     float cumsum = 0.0f;
     int chosen = K - 1;  // por defecto la última clase
     for (int k = 0; k < K; k++) {
@@ -73,8 +103,7 @@ float generate_leaf_value(int *seed,
     // 4) Si la clase elegida está al 100% de accuracy,
     //    tenemos un 50% de probabilidad de abstenernos
     if (class_accuracy[chosen] >= 0.99f) {
-        // rand_r devuelve 0..RAND_MAX, comparamos con RAND_MAX/2
-        if ((rand_r(seed) & 0x1) == 0) {
+        if ((rng_rand(rng) & 0x1) == 0) {
             return NULL_VOTE;
         }
     }
@@ -84,183 +113,237 @@ float generate_leaf_value(int *seed,
 }
 
 
-uint8_t generate_leaf_node(uint8_t prob__leaf_node, int *seed) {
-    uint8_t random_8 = (uint8_t)rand_r(seed) % 100;
+uint8_t generate_leaf_node(uint8_t prob__leaf_node, struct rng *rng) {
+    uint8_t random_8 = (uint8_t)rng_rand(rng) % 100;
 
     return random_8 > prob__leaf_node;
 }
 
-uint8_t generate_feture_index(uint8_t feature_length, int *seed) {
-    uint8_t random_8 = (uint8_t)rand_r(seed) % feature_length;
+uint8_t generate_feture_index(uint8_t feature_length, struct rng *rng) {
+    uint8_t random_8 = (uint8_t)rng_rand(rng) % feature_length;
 
     return random_8;
 }
 
-void initialize_trees(tree_data trees[N_TREES][N_NODE_AND_LEAFS]){
+int alloc_population(struct population *population)
+{
+    population->pool   = malloc(sizeof(*population->pool) * POPULATION);
+    population->frozen = malloc(sizeof(tree_t) * N_TREES);
+    if (population->pool == NULL || population->frozen == NULL) {
+        free_population(population);
+        return -1;
+    }
+
+    population->seed = 0;
+    population->generation = 0;
+    for (int p = 0; p < POPULATION; p++) {
+        population->rank[p] = p;
+        population->accuracy[p] = 0;
+        initialize_trees(population->pool[p], N_BOOSTING);
+    }
+    initialize_trees(population->frozen, N_TREES);
+
+    return 0;
+}
+
+void free_population(struct population *population)
+{
+    free(population->pool);
+    free(population->frozen);
+    population->pool   = NULL;
+    population->frozen = NULL;
+}
+
+// Stage boosting_i is over: its slice of the best individual joins the shared trees
+void freeze_stage(struct population *population, uint32_t boosting_i)
+{
+    memcpy(population->frozen[boosting_i * N_BOOSTING], individual(population, 0),
+            sizeof(tree_t) * N_BOOSTING);
+}
+
+void initialize_trees(tree_t *trees, int n_trees){
     
-    for (int t = 0; t < N_TREES; t++)
+    memset(trees, 0, sizeof(tree_data) * n_trees * N_NODE_AND_LEAFS);
+    for (int t = 0; t < n_trees; t++)
         for (int n = 0; n < N_NODE_AND_LEAFS; n++)
             trees[t][n].tree_camps.float_int_union.i=NULL_VOTE;
     
 }
 
-void generate_random_trees(tree_data trees[N_TREES][N_NODE_AND_LEAFS], 
-                    uint8_t n_features, uint16_t boosting_i, float max_features[N_FEATURE],
-                    float min_features[N_FEATURE], int n_classes) {
+void generate_random_trees(tree_t trees[N_BOOSTING], uint8_t n_features,
+                    float max_features[N_FEATURE], float min_features[N_FEATURE], int n_classes,
+                    struct rng *rng) {
 
-    srand(clock());
     uint8_t n_feature;
-    int seed = (int)trees;
     float class_100x100[256] = {0};
 
-    for (uint32_t tree_i = boosting_i * N_BOOSTING; 
-                tree_i < (boosting_i + 1) * N_BOOSTING && tree_i < N_TREES; tree_i++) {
+    for (uint32_t t = 0; t < N_BOOSTING; t++) {
         for (uint32_t node_i = 0; node_i < N_NODE_AND_LEAFS - 1; node_i++) {
-            seed = seed + time(NULL) + tree_i + node_i;
-            trees[tree_i][node_i].tree_camps.feature_index = generate_feture_index(n_features, &seed);
-            n_feature = trees[tree_i][node_i].tree_camps.feature_index;
+            struct tree_camps *camps = &trees[t][node_i].tree_camps;
+
+            camps->feature_index = generate_feture_index(n_features, rng);
+            n_feature = camps->feature_index;
             
-            trees[tree_i][node_i].tree_camps.leaf_or_node = 
-                   (right_index[node_i] == 0) ? 0x00 : generate_leaf_node(60, &seed);
+            camps->leaf_or_node = (right_index[node_i] == 0) ? 0x00 : generate_leaf_node(60, rng);
 
             if (node_i < 4) {
-                trees[tree_i][node_i].tree_camps.leaf_or_node = 1;
+                camps->leaf_or_node = 1;
             }
 
-            if (trees[tree_i][node_i].tree_camps.leaf_or_node == 0) {
-                trees[tree_i][node_i].tree_camps.float_int_union.i =
-                    generate_leaf_value(&seed, n_classes, class_100x100);
+            if (camps->leaf_or_node == 0) {
+                camps->float_int_union.i = generate_leaf_value(rng, n_classes, class_100x100);
             } else {
-                trees[tree_i][node_i].tree_camps.float_int_union.f =
-                    generate_threshold(min_features[n_feature], max_features[n_feature], &seed);
+                camps->float_int_union.f =
+                    generate_threshold(min_features[n_feature], max_features[n_feature], rng);
             }
                
-            trees[tree_i][node_i].tree_camps.next_node_right_index = right_index[node_i];
+            camps->next_node_right_index = right_index[node_i];
         }
     }
 }
 
-void mutate_trees(tree_data input_tree[N_TREES][N_NODE_AND_LEAFS], 
-                 tree_data output_tree[N_TREES][N_NODE_AND_LEAFS],
+void mutate_trees(tree_t input_tree[N_BOOSTING], 
+                 tree_t output_tree[N_BOOSTING],
                  uint8_t n_features, float mutation_rate, 
-                 uint32_t boosting_i, float max_features[N_FEATURE], float min_features[N_FEATURE],
-                  int *seed, int n_classes, float class_100x100[]) {
+                 float max_features[N_FEATURE], float min_features[N_FEATURE],
+                  struct rng *rng, int n_classes, float class_100x100[]) {
 
-    uint32_t mutation_threshold = mutation_rate * RAND_MAX;
+    uint32_t mutation_threshold = mutation_rate * RNG_MAX;
     uint8_t n_feature;
     uint32_t mutation_value;
-    memcpy(output_tree, input_tree, sizeof(tree_data) * N_TREES * N_NODE_AND_LEAFS);
+    memcpy(output_tree, input_tree, sizeof(tree_t) * N_BOOSTING);
     
-    for (uint32_t tree_i = boosting_i * N_BOOSTING; 
-                tree_i < (boosting_i + 1) * N_BOOSTING && tree_i < N_TREES; tree_i++){
+    for (uint32_t t = 0; t < N_BOOSTING; t++){
 
         for (uint32_t node_i = 0; node_i < N_NODE_AND_LEAFS - 1; node_i++){
-            *seed = *seed + tree_i;
-            mutation_value = rand_r(seed);
+            struct tree_camps *camps = &output_tree[t][node_i].tree_camps;
+
+            mutation_value = rng_rand(rng);
             if (mutation_value < mutation_threshold){
-                *seed = *seed + node_i;
-                output_tree[tree_i][node_i].tree_camps.feature_index = generate_feture_index(n_features, seed);
-                n_feature = output_tree[tree_i][node_i].tree_camps.feature_index;
-                output_tree[tree_i][node_i].tree_camps.leaf_or_node =  
-                    (right_index[node_i] == 0) ? 0x00 : generate_leaf_node(60, seed);
+                camps->feature_index = generate_feture_index(n_features, rng);
+                n_feature = camps->feature_index;
+                camps->leaf_or_node = (right_index[node_i] == 0) ? 0x00 :
+                                                                   generate_leaf_node(60, rng);
                 if (node_i < 4){
-                    output_tree[tree_i][node_i].tree_camps.leaf_or_node = 1;
+                    camps->leaf_or_node = 1;
                 }
 
-                if (output_tree[tree_i][node_i].tree_camps.leaf_or_node == 0){
-                    output_tree[tree_i][node_i].tree_camps.float_int_union.i =
-                        generate_leaf_value(seed, n_classes, class_100x100);
+                if (camps->leaf_or_node == 0){
+                    camps->float_int_union.i = generate_leaf_value(rng, n_classes, class_100x100);
                 }else{
-                    output_tree[tree_i][node_i].tree_camps.float_int_union.f =
-                        generate_threshold(min_features[n_feature], max_features[n_feature], seed);
+                    camps->float_int_union.f =
+                        generate_threshold(min_features[n_feature], max_features[n_feature], rng);
                 }
 
-                output_tree[tree_i][node_i].tree_camps.next_node_right_index = right_index[node_i];
+                camps->next_node_right_index = right_index[node_i];
             }
         }
     }
 }
 
-void tune_nodes(tree_data input_tree[N_TREES][N_NODE_AND_LEAFS], 
-                 tree_data output_tree[N_TREES][N_NODE_AND_LEAFS],
+void tune_nodes(tree_t input_tree[N_BOOSTING], 
+                 tree_t output_tree[N_BOOSTING],
                  uint8_t n_features, float mutation_rate, 
-                 uint32_t boosting_i, float max_features[N_FEATURE], float min_features[N_FEATURE], int *seed) {
+                 float max_features[N_FEATURE], float min_features[N_FEATURE],
+                 struct rng *rng) {
 
-    uint32_t mutation_threshold = mutation_rate * RAND_MAX;
+    uint32_t mutation_threshold = mutation_rate * RNG_MAX;
     uint8_t n_feature;
-    memcpy(output_tree, input_tree, sizeof(tree_data) * N_TREES * N_NODE_AND_LEAFS);
+    memcpy(output_tree, input_tree, sizeof(tree_t) * N_BOOSTING);
     
-    for (uint32_t tree_i = boosting_i * N_BOOSTING; 
-                tree_i < (boosting_i + 1) * N_BOOSTING && tree_i < N_TREES; tree_i++){
+    for (uint32_t t = 0; t < N_BOOSTING; t++){
 
-        *seed = *seed + tree_i;
-        uint32_t mutation_value = rand_r(seed);
+        uint32_t mutation_value = rng_rand(rng);
         if (mutation_value < mutation_threshold){
             for (uint32_t node_i = 0; node_i < N_NODE_AND_LEAFS - 1; node_i++){
-                *seed = *seed + node_i;
+                struct tree_camps *camps = &output_tree[t][node_i].tree_camps;
 
-                n_feature = output_tree[tree_i][node_i].tree_camps.feature_index;
+                n_feature = camps->feature_index;
 
-                if (output_tree[tree_i][node_i].tree_camps.leaf_or_node){
-                    output_tree[tree_i][node_i].tree_camps.float_int_union.f +=
-                        generate_threshold(min_features[n_feature]/10, max_features[n_feature]/10, seed);
+                if (camps->leaf_or_node){
+                    camps->float_int_union.f += generate_threshold(min_features[n_feature]/10,
+                                                                   max_features[n_feature]/10, rng);
                 }
             }
         }
     }
 }
 
-void reproducee_trees(tree_data mother[N_TREES][N_NODE_AND_LEAFS],
-                        tree_data father[N_TREES][N_NODE_AND_LEAFS],
-                        tree_data son[N_TREES][N_NODE_AND_LEAFS], uint32_t boosting_i){
+void reproducee_trees(tree_t mother[N_BOOSTING], tree_t father[N_BOOSTING],
+                        tree_t son[N_BOOSTING], struct rng *rng){
 
 
-    for (uint32_t tree_i = boosting_i * N_BOOSTING; 
-                tree_i < (boosting_i + 1) * N_BOOSTING && tree_i < N_TREES; tree_i++){
+    for (uint32_t t = 0; t < N_BOOSTING; t++){
 
-        if(rand() % 2){
-            memcpy(son[tree_i], mother[tree_i], sizeof(tree_data) * N_NODE_AND_LEAFS);
+        if(rng_rand(rng) % 2){
+            memcpy(son[t], mother[t], sizeof(tree_data) * N_NODE_AND_LEAFS);
         }else{
-            memcpy(son[tree_i], father[tree_i], sizeof(tree_data) * N_NODE_AND_LEAFS);
+            memcpy(son[t], father[t], sizeof(tree_data) * N_NODE_AND_LEAFS);
         }
     }
 }
 
-void crossover(tree_data trees_population[POPULATION][N_TREES][N_NODE_AND_LEAFS], uint32_t boosting_i){
+// The parents are the first ranks, the sons the last ones, so the sons are built in parallel
+void crossover(struct population *population){
 
     int group_size = POPULATION / 80;
     if (group_size == 0) group_size = 1;
 
-    for (uint32_t p = POPULATION - POPULATION/10; p < POPULATION; p++){
-        int index_mother = rand() % group_size;
-        int index_father = rand() % group_size + group_size;
+    #pragma omp parallel for schedule(dynamic)
+    for (int p = POPULATION - POPULATION/10; p < POPULATION; p++){
+        struct rng rng;
+        individual_rng(&rng, population, RNG_CROSSOVER, p);
+
+        int index_mother = rng_rand(&rng) % group_size;
+        int index_father = rng_rand(&rng) % group_size + group_size;
 
-        reproducee_trees(trees_population[index_mother], trees_population[index_father],
-                                trees_population[p], boosting_i);
+        reproducee_trees(individual(population, index_mother),
+                                individual(population, index_father),
+                                individual(population, p), &rng);
     }
 
 }
 
-void mutate_population(tree_data trees_population[POPULATION][N_TREES][N_NODE_AND_LEAFS],
-                        float population_accuracy[POPULATION], float max_features[N_FEATURE],
+void generate_population(struct population *population, uint8_t n_features,
+                            float max_features[N_FEATURE], float min_features[N_FEATURE],
+                            int n_classes){
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int p = 0; p < POPULATION; p++){
+        struct rng rng;
+        individual_rng(&rng, population, RNG_GENERATE, p);
+
+        generate_random_trees(individual(population, p), n_features,
+                                max_features, min_features, n_classes, &rng);
+    }
+}
+
+/*
+ * The elites are the first POPULATION/4 ranks and only the ranks after them
+ * are rewritten, so the mutants are built straight from the elite trees and
+ * each thread writes its own individuals.
+ */
+void mutate_population(struct population *population, float max_features[N_FEATURE],
                         float min_features[N_FEATURE], uint8_t n_features, float mutation_factor, 
-                        uint32_t boosting_i, int n_classes, float class_100x100[]){
+                        int n_classes, float class_100x100[]){
 
-    for (uint32_t p = POPULATION/4; p < POPULATION; p++) {
-        unsigned int seed = time(NULL) + p;
-        int index_elite = rand_r(&seed) % (POPULATION/4);
+    #pragma omp parallel for schedule(dynamic)
+    for (int p = POPULATION/4; p < POPULATION; p++) {
+        struct rng rng;
+        individual_rng(&rng, population, RNG_MUTATE, p);
 
-        tree_data local_tree[N_TREES][N_NODE_AND_LEAFS];
-        memcpy(local_tree, trees_population[index_elite], sizeof(local_tree));
-        int threshold = (int)((POPULATION/8)* population_accuracy[index_elite]);
+        int index_elite = rng_rand(&rng) % (POPULATION/4);
+
+        tree_t *elite_tree = individual(population, index_elite);
+        int threshold = (int)((POPULATION/8)* population->accuracy[index_elite]);
         if (index_elite < threshold || mutation_factor >= (MEMORY_ACU_SIZE - 2)*0.02){
-            tune_nodes(local_tree, trees_population[p], n_features,
+            tune_nodes(elite_tree, individual(population, p), n_features,
                         0.5 + mutation_factor*3,
-                        boosting_i, max_features, min_features, &seed);
+                        max_features, min_features, &rng);
         }else{
-            mutate_trees(local_tree, trees_population[p], n_features,
+            mutate_trees(elite_tree, individual(population, p), n_features,
                         0.5 + mutation_factor,
-                        boosting_i, max_features, min_features, &seed, n_classes, class_100x100);
+                        max_features, min_features, &rng, n_classes, class_100x100);
         }
         
     }
@@ -272,115 +355,108 @@ void swap_int(int *a, int *b) {
     *b = temp;
 }
 
-// Ordenamiento por índices (sin tocar los datos pesados)
-int partition(const float population_accuracy[POPULATION], int idx[POPULATION], int low, int high) {
-    float pivot = population_accuracy[idx[high]];
-    int i = low - 1;
-    for (int j = low; j < high; j++) {
-        if (population_accuracy[idx[j]] > pivot) {
-            i++;
-            swap_int(&idx[i], &idx[j]);
-        }
-    }
-    swap_int(&idx[i + 1], &idx[high]);
-    return i + 1;
-}
+// Los elites y el rango POPULATION/4, que randomize_percent puede subir entre ellos
+#define N_RANKED (POPULATION/4 + 1)
 
-void quicksort_idx(const float population_accuracy[POPULATION], int idx[POPULATION], int low, int high) {
-    while (low < high) {
-        int pi = partition(population_accuracy, idx, low, high);
-        if (pi - low < high - pi) {
-            quicksort_idx(population_accuracy, idx, low, pi - 1);
-            low = pi + 1;
-        } else {
-            quicksort_idx(population_accuracy, idx, pi + 1, high);
-            high = pi - 1;
-        }
-    }
+// Orden de los rangos: más accuracy primero, a igualdad el rango más bajo
+static int ranks_before(const float population_accuracy[POPULATION], int a, int b) {
+    if (population_accuracy[a] != population_accuracy[b])
+        return population_accuracy[a] > population_accuracy[b];
+    return a < b;
 }
 
-void swap_trees(float population_accuracy[POPULATION], 
-                tree_data trees_population[POPULATION][N_TREES][N_NODE_AND_LEAFS],
-                int used_trees) {
+// Hunde heap[i] en un montículo cuya raíz es el peor de los elegidos
+static void sift_down(const float population_accuracy[POPULATION], int heap[], int n, int i) {
+    while (1) {
+        int worst = i;
+        int l = 2 * i + 1;
+        int r = l + 1;
 
-    int idx[POPULATION];
-    for (int i = 0; i < POPULATION; i++) {
-        idx[i] = i;
+        if (l < n && ranks_before(population_accuracy, heap[worst], heap[l])) worst = l;
+        if (r < n && ranks_before(population_accuracy, heap[worst], heap[r])) worst = r;
+        if (worst == i) return;
+
+        swap_int(&heap[i], &heap[worst]);
+        i = worst;
     }
+}
 
-    // 1. Ordenar índices según accuracy
-    quicksort_idx(population_accuracy, idx, 0, POPULATION - 1);
+/*
+ * Selección parcial: solo los N_RANKED mejores quedan ordenados al frente,
+ * que son los que leen la mutación, el cruce y la mezcla. El resto va
+ * detrás sin ordenar porque se reescribe. Basta un montículo de N_RANKED
+ * índices, sin ordenar toda la población. Los rangos se mueven, los
+ * árboles no.
+ */
+void select_elites(struct population *population) {
+
+    int heap[N_RANKED];
+    int rank[POPULATION];
+    float accuracy[POPULATION];
+    uint8_t elite[POPULATION] = {0};
+    int n = 0;
+
+    for (int i = 0; i < N_RANKED; i++) {
+        heap[i] = i;
+    }
+    for (int i = N_RANKED / 2 - 1; i >= 0; i--) {
+        sift_down(population->accuracy, heap, N_RANKED, i);
+    }
+    for (int i = N_RANKED; i < POPULATION; i++) {
+        if (ranks_before(population->accuracy, i, heap[0])) {
+            heap[0] = i;
+            sift_down(population->accuracy, heap, N_RANKED, 0);
+        }
+    }
 
-    // 2. Reordenar temporalmente los datos
-    float temp_accuracy[POPULATION];
-    tree_data temp_trees[POPULATION][N_TREES][N_NODE_AND_LEAFS];
+    // Vaciar el montículo del peor al mejor deja los elites ordenados
+    for (int k = N_RANKED - 1; k >= 0; k--) {
+        int i = heap[0];
 
-    for (int i = 0; i < POPULATION; i++) {
-        temp_accuracy[i] = population_accuracy[idx[i]];
-        memcpy(temp_trees[i], trees_population[idx[i]], sizeof(tree_data) * N_TREES * N_NODE_AND_LEAFS);
+        elite[i] = 1;
+        rank[k] = population->rank[i];
+        accuracy[k] = population->accuracy[i];
+        heap[0] = heap[k];
+        sift_down(population->accuracy, heap, k, 0);
     }
+    n = N_RANKED;
 
-    // 3. Volcar los datos ya ordenados a las estructuras originales
-    memcpy(population_accuracy, temp_accuracy, sizeof(temp_accuracy));
     for (int i = 0; i < POPULATION; i++) {
-        memcpy(trees_population[i], temp_trees[i], sizeof(tree_data)*N_NODE_AND_LEAFS*used_trees);
+        if (!elite[i]) {
+            rank[n] = population->rank[i];
+            accuracy[n] = population->accuracy[i];
+            n++;
+        }
     }
+
+    memcpy(population->rank, rank, sizeof(rank));
+    memcpy(population->accuracy, accuracy, sizeof(accuracy));
 }
 
-void randomize_percent(float population_accuracy[POPULATION], 
-                       tree_data trees_population[POPULATION][N_TREES][N_NODE_AND_LEAFS],
-                       float percentage_randomize) {
+// Mezcla los rangos 1..M, el mejor individuo se queda en el rango 0
+void randomize_percent(struct population *population, float percentage_randomize) {
 
     int N = POPULATION;
     int M = (int)(N * percentage_randomize);
+    struct rng rng;
     if (M < 1) M = 1;
+    if (M > N - 1) M = N - 1;
 
-    int selected_idx[M];
-    for (int i = 0; i < M; i++) {
-        selected_idx[i] = i + 1;  // ignoramos el índice 0
-    }
-
-    // Mezclar los índices seleccionados
-    for (int i = M - 1; i > 0; i--) {
-        int j = rand() % (i + 1);
-        swap_int(&selected_idx[i], &selected_idx[j]);
-    }
-
-    // Reordenar localmente
-    float tmp_accuracy[M];
-    tree_data tmp_trees[M][N_TREES][N_NODE_AND_LEAFS];
-
-    for (int i = 0; i < M; i++) {
-        int idx = selected_idx[i];
-        tmp_accuracy[i] = population_accuracy[idx];
-        memcpy(tmp_trees[i], trees_population[idx], sizeof(tree_data) * N_TREES * N_NODE_AND_LEAFS);
-    }
-
-    // Reordenar (mezclar)
-    for (int i = M - 1; i > 0; i--) {
-        int j = rand() % (i + 1);
-        swap_int(&tmp_accuracy[i], &tmp_accuracy[j]);
+    individual_rng(&rng, population, RNG_REORGANIZE, 0);
+    for (int i = M; i > 1; i--) {
+        int j = 1 + rng_rand(&rng) % i;
+        float accuracy = population->accuracy[i];
 
-        tree_data tmp[N_TREES][N_NODE_AND_LEAFS];
-        memcpy(tmp, tmp_trees[i], sizeof(tree_data) * N_TREES * N_NODE_AND_LEAFS);
-        memcpy(tmp_trees[i], tmp_trees[j], sizeof(tree_data) * N_TREES * N_NODE_AND_LEAFS);
-        memcpy(tmp_trees[j], tmp, sizeof(tree_data) * N_TREES * N_NODE_AND_LEAFS);
-    }
-
-    // Volcar elementos mezclados de vuelta
-    for (int i = 0; i < M; i++) {
-        int idx = selected_idx[i];
-        population_accuracy[idx] = tmp_accuracy[i];
-        memcpy(trees_population[idx], tmp_trees[i], sizeof(tree_data) * N_TREES * N_NODE_AND_LEAFS);
+        swap_int(&population->rank[i], &population->rank[j]);
+        population->accuracy[i] = population->accuracy[j];
+        population->accuracy[j] = accuracy;
     }
 }
 
-void reorganize_population(float population_accuracy[POPULATION], 
-                    tree_data trees_population[POPULATION][N_TREES][N_NODE_AND_LEAFS],
-                    int used_trees) {
+void reorganize_population(struct population *population) {
 
-    swap_trees(population_accuracy, trees_population, used_trees);
-    randomize_percent(population_accuracy, trees_population, 0.25f);
+    select_elites(population);
+    randomize_percent(population, 0.25f);
 }
 
 void find_max_min_features(struct feature features[MAX_TEST_SAMPLES],
@@ -421,9 +497,9 @@ void swap_features(struct feature* a, struct feature* b) {
     *b = temp;
 }
 
-void shuffle(struct feature* array, int n) {
+void shuffle(struct feature* array, int n, struct rng *rng) {
     for (int i = n - 1; i > 0; i--) {
-        int j = rand() % (i + 1);
+        int j = rng_rand(rng) % (i + 1);
         swap_features(&array[i], &array[j]);
     }
 }
@@ -431,16 +507,15 @@ void shuffle(struct feature* array, int n) {
 int augment_features(const struct feature *original_features, int n_features, int n_col,
                      float max_features[N_FEATURE], float min_features[N_FEATURE],
                      struct feature *augmented_features, int max_augmented_features, 
-                     int augmentation_factor) {
+                     int augmentation_factor, uint64_t seed) {
 
     int total_augmented = 0;
     int i, j, k;
-    int seed;
+    struct rng rng;
     float noise_level = 0.05f;  // Nivel de ruido (ajustable según necesidad)
 
-
-    // Semilla para el generador de números aleatorios
-    srand((unsigned int)time(NULL));
+    // El ruido sale de la semilla de la ejecución
+    rng_init(&rng, seed, (uint64_t)RNG_AUGMENT << 24);
 
     for (i = 0; i < n_features; i++) {
         // Verificar si hay espacio en augmented_features
@@ -462,9 +537,8 @@ int augment_features(const struct feature *original_features, int n_features, in
 
             // Agregar ruido aleatorio a cada característica
             for (k = 0; k < n_col && k < N_FEATURE; k++) {
-                seed = i*n_col*augmentation_factor + j*n_col + k;
                 if (!(min_features == 0 && max_features == 0)){
-                    float noise = generate_random_float(min_features[k]/10, max_features[k]/10, &seed);
+                    float noise = generate_random_float(min_features[k]/10, max_features[k]/10, &rng);
                     new_feature.features[k] += noise;
                 }
                 
@@ -26,6 +26,11 @@
 #define MAX_BURST 5000          // Adjust according to the maximum amount of somples to process in 1 busrt
 #define NULL_VOTE -1
 
+// Every boosting stage evolves a full slice of N_BOOSTING trees
+#if N_TREES % N_BOOSTING
+#error "N_TREES must be a multiple of N_BOOSTING"
+#endif
+
 #define FALSE 0
 #define TRUE  1
 
@@ -48,44 +53,114 @@ typedef union {
   uint64_t compact_data;
 } tree_data;
 
+typedef tree_data tree_t[N_NODE_AND_LEAFS];
+
+// PCG32 generator, rng_rand() returns 0..RNG_MAX like rand()
+#define RNG_MAX 0x7fffffff
+
+struct rng {
+  uint64_t state;
+  uint64_t inc;
+};
+
+static inline uint32_t rng_next(struct rng *rng)
+{
+  uint64_t old = rng->state;
+  uint32_t xorshifted = ((old >> 18) ^ old) >> 27;
+  uint32_t rot = old >> 59;
+
+  rng->state = old * 6364136223846793005ULL + rng->inc;
+  return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
+static inline uint32_t rng_rand(struct rng *rng)
+{
+  return rng_next(rng) >> 1;
+}
+
+void rng_init(struct rng *rng, uint64_t seed, uint64_t stream);
+
+// Operators that draw random numbers, each gets its own streams
+enum rng_stream {
+  RNG_GENERATE,
+  RNG_MUTATE,
+  RNG_CROSSOVER,
+  RNG_REORGANIZE,
+  RNG_SHUFFLE,
+  RNG_AUGMENT
+};
+
 struct feature {
   float features[N_FEATURE];
   uint8_t prediction;
 };
 
-void generate_random_trees(tree_data trees[N_TREES][N_NODE_AND_LEAFS], 
-                    uint8_t n_features, uint16_t boosting_i, float max_features[N_FEATURE],
-                    float min_features[N_FEATURE], int n_classes);
+/*
+ * Individuals of the genetic algorithm. They live in one heap arena and are
+ * addressed by rank: rank[r] is the slot in the arena of the r-th individual,
+ * the best one after reorganize_population(), and accuracy[r] its fitness.
+ * Ranking and shuffling only move ranks, the trees stay in place.
+ * A boosting stage only evolves its N_BOOSTING trees, so an individual owns
+ * just that slice. The trees of the finished stages, and the not yet trained
+ * ones, are the same for everybody and are kept once in frozen.
+ */
+struct population {
+  tree_t (*pool)[N_BOOSTING];
+  tree_t *frozen;
+  int rank[POPULATION];
+  float accuracy[POPULATION];
+  uint64_t seed;            // seed of the run, every random stream derives from it
+  uint32_t generation;      // generations evolved so far, over all the stages
+};
+
+static inline tree_t *individual(const struct population *population, int rank)
+{
+  return population->pool[population->rank[rank]];
+}
+
+int alloc_population(struct population *population);
+
+void free_population(struct population *population);
+
+void freeze_stage(struct population *population, uint32_t boosting_i);
+
+void individual_rng(struct rng *rng, const struct population *population,
+                    enum rng_stream op, uint32_t p);
+
+void generate_random_trees(tree_t trees[N_BOOSTING], uint8_t n_features,
+                    float max_features[N_FEATURE], float min_features[N_FEATURE], int n_classes,
+                    struct rng *rng);
+
+void generate_population(struct population *population, uint8_t n_features,
+                            float max_features[N_FEATURE], float min_features[N_FEATURE],
+                            int n_classes);
 
-void mutate_population(tree_data trees_population[POPULATION][N_TREES][N_NODE_AND_LEAFS],
-                        float population_accuracy[POPULATION], float max_features[N_FEATURE],
+void mutate_population(struct population *population, float max_features[N_FEATURE],
                         float min_features[N_FEATURE], uint8_t n_features, float mutation_factor, 
-                        uint32_t boosting_i, int n_classes, float class_100x100[]);
+                        int n_classes, float class_100x100[]);
 
-void crossover(tree_data trees_population[POPULATION][N_TREES][N_NODE_AND_LEAFS], uint32_t boosting_i);
+void crossover(struct population *population);
 
-void reorganize_population(float population_accuracy[POPULATION], 
-                          tree_data trees_population[POPULATION][N_TREES][N_NODE_AND_LEAFS],
-                          int used_trees);
+void reorganize_population(struct population *population);
 
 int augment_features(const struct feature *original_features, int n_features, int n_col,
                      float max_features[N_FEATURE], float min_features[N_FEATURE],
                      struct feature *augmented_features, int max_augmented_features, 
-                     int augmentation_factor);
+                     int augmentation_factor, uint64_t seed);
 
 void find_max_min_features(struct feature features[MAX_TEST_SAMPLES],
                                 float max_features[N_FEATURE], 
                                 float min_features[N_FEATURE],
                                 int read_samples);
 
-float generate_random_float(float min, float max, int* seed);
+float generate_random_float(float min, float max, struct rng *rng);
 
 void swap_features(struct feature* a, struct feature* b);
 
-void shuffle(struct feature* array, int n);
+void shuffle(struct feature* array, int n, struct rng *rng);
 
 void find_n_classes(struct feature features[MAX_TEST_SAMPLES], int *n_classes, 
                                                             int read_samples);
 
-void initialize_trees(tree_data trees[N_TREES][N_NODE_AND_LEAFS]);
+void initialize_trees(tree_t *trees, int n_trees);
 #endif // __TRAIN_H__
\ No newline at end of file
@@ -1,9 +1,13 @@
 // Copyright (c) 2011-2024 Columbia University, System Level Design Group
 // SPDX-License-Identifier: Apache-2.0
+#include <getopt.h>
 #include "libesp.h"
 #include "cfg.h"
 #include "monitors.h"
 #include "train.h"
+#include "fitness.h"
+#include "parse.h"
+#include "packed.h"
 
 static unsigned in_words_adj;
 static unsigned out_words_adj;
@@ -20,38 +24,87 @@ union stamps{
 };
 
 
-int read_n_features(const char *csv_file, int n, struct feature *features, int *n_col) {
-    FILE *file = fopen(csv_file, "r");
+// Copies a packed dataset, see packed.h, into a heap array of samples
+struct feature *read_packed_features(const char *filename, int *read_samples, int *n_col) {
+    struct packed_dataset packed;
+    struct feature *features;
+
+    if (map_packed_dataset(filename, &packed))
+        return NULL;
+
+    features = malloc(sizeof(struct feature) * (packed.n_samples ? packed.n_samples : 1));
+    if (features == NULL) {
+        printf("Out of memory reading %s\n", filename);
+        unmap_packed_dataset(&packed);
+        return NULL;
+    }
+
+    for (uint32_t s = 0; s < packed.n_samples; s++) {
+        memset(&features[s], 0, sizeof(struct feature));
+        copy_packed_samples(&packed, s, 1, features[s].features, N_FEATURE,
+                            &features[s].prediction);
+    }
+
+    *read_samples = packed.n_samples;
+    *n_col = packed.n_columns + 1;
+    unmap_packed_dataset(&packed);
+    return features;
+}
+
+/*
+ * Reads the whole dataset file, CSV, space separated or packed, into a heap
+ * array that grows by doubling. The trainer shuffles and re-evaluates every
+ * sample on each generation, so unlike the execute app it keeps the dataset
+ * in memory, but without a fixed cap.
+ */
+struct feature *read_n_features(const char *csv_file, int *read_samples, int *n_col) {
+    FILE *file;
     char line[MAX_LINE_LENGTH];
+    struct feature *features = NULL;
+    int capacity = 0;
     int features_read = 0;
-    int i;
+    int n_values;
+
+    if (is_packed_dataset(csv_file))
+        return read_packed_features(csv_file, read_samples, n_col);
 
+    file = fopen(csv_file, "r");
     if (!file) {
         perror("Failed to open the file");
-        return -1;
+        return NULL;
     }
 
-    while (fgets(line, MAX_LINE_LENGTH, file) && features_read < n) {
-        float temp[N_FEATURE + 1];
-        char *token = strtok(line, ",");
-        *n_col = 0;
+    while (fgets(line, MAX_LINE_LENGTH, file)) {
+        float label;
 
-        while (token != NULL && (*n_col) < N_FEATURE + 1) {
-            temp[*n_col] = atof(token);
-            token = strtok(NULL, ",");
-            (*n_col)++;
-        }
+        if (features_read == capacity) {
+            struct feature *grown;
 
-        for (i = 0; i < *n_col - 1; i++) {
-            features[features_read].features[i] = temp[i];
+            capacity = capacity ? 2 * capacity : MAX_BURST;
+            grown = realloc(features, capacity * sizeof(struct feature));
+            if (grown == NULL) {
+                printf("Out of memory reading %s\n", csv_file);
+                free(features);
+                fclose(file);
+                return NULL;
+            }
+            features = grown;
         }
-        features[features_read].prediction = (uint8_t) temp[*n_col - 1];
+
+        memset(&features[features_read], 0, sizeof(struct feature));
+        n_values = parse_row(line, features[features_read].features, N_FEATURE, &label);
+        if (n_values < 1)
+            continue;
+
+        features[features_read].prediction = (uint8_t) label;
+        *n_col = n_values + 1;
 
         features_read++;
     }
 
     fclose(file);
-    return features_read;
+    *read_samples = features_read;
+    return features;
 }
 
 /* User-defined code */
@@ -68,11 +121,12 @@ static void init_parameters()
     size       = (out_offset * sizeof(token_t)) + out_size;
 }
 
-void coppy_trees(tree_data tree[N_TREES][N_NODE_AND_LEAFS], token_t *buf)
+// Writes n_trees trees to their place in the model buffer, starting at tree first_tree
+void coppy_trees(tree_t *tree, int first_tree, int n_trees, token_t *buf)
 {
-    for (int t = 0; t < N_TREES; t++) {
+    for (int t = 0; t < n_trees; t++) {
         for (int n = 0; n < N_NODE_AND_LEAFS; n++) {
-            buf[t * N_NODE_AND_LEAFS + n] = tree[t][n].compact_data;
+            buf[(first_tree + t) * N_NODE_AND_LEAFS + n] = tree[t][n].compact_data;
         }
     }
 }
@@ -87,14 +141,35 @@ void copy_features_bytes(token_t *mem, const struct feature *features, int n_fea
     }
 }
 
-void send_trees(token_t *buf)
+/*
+ * Loads the trees [first_tree, first_tree + n_trees) of the model in buf,
+ * the other trees already in the accelerator are kept. Returns -1 without
+ * touching the accelerator when the range does not fit in its N_TREES trees.
+ */
+int send_trees(token_t *buf, int first_tree, int n_trees)
 {
-    
+    // The accelerator writes its capability word and its clock stamps over
+    // the first two nodes of tree 0
+    token_t first_nodes[2] = {buf[0], buf[1]};
+
+    if (first_tree < 0 || n_trees < 1 || n_trees > N_TREES - first_tree) {
+        printf("Trees [%i, %i) out of the %i trees of the accelerator\n", first_tree,
+                first_tree + n_trees, N_TREES);
+        return -1;
+    }
+
     trees_cfg_000[0].burst_len = 0;
     trees_cfg_000[0].load_trees = 1;
+    trees_cfg_000[0].tree_offset = first_tree;
+    trees_cfg_000[0].tree_count = n_trees;
     cfg_000[0].hw_buf = buf;
     esp_run(cfg_000, NACC);
 
+    // Keep the buffer a valid model for the next uploads
+    buf[0] = first_nodes[0];
+    buf[1] = first_nodes[1];
+
+    return 0;
 }
 
 void perform_inferences_hw(token_t *buf, struct feature *features, int read_samples,
@@ -147,15 +222,16 @@ void print_accuracy(struct feature *features, uint8_t *predictions,
            evaluated_total, read_samples);
 }
 
-void evaluate_model(token_t *buf, struct feature *features, int read_samples, int n_classes,
-                    uint8_t *predictions, uint32_t max_burst, float *exe_time_ms, uint8_t new_features)
+void evaluate_model(token_t *trees_buf, token_t *buf, struct feature *features, int read_samples,
+                    int n_classes, uint8_t *predictions, uint32_t max_burst, float *exe_time_ms,
+                    uint8_t new_features)
 {
     uint32_t processed = 0;
     uint32_t burst;
     float exe_t;
     *exe_time_ms = 0;
 
-    send_trees(buf);
+    send_trees(trees_buf, 0, N_TREES);
 
     while (processed < read_samples) {
         burst =
@@ -171,7 +247,7 @@ void evaluate_model(token_t *buf, struct feature *features, int read_samples, in
     print_accuracy(features, predictions, read_samples, n_classes);
 }
 
-void get_accuracy(struct feature *features, int read_samples, uint8_t *prediction, float *accuracy){
+int count_correct(const struct feature *features, int read_samples, const uint8_t *prediction){
 
     int correct = 0;
 
@@ -180,9 +256,8 @@ void get_accuracy(struct feature *features, int read_samples, uint8_t *predictio
             correct++;
         }
     }
-    
-    *accuracy = (float) correct / (float) read_samples;
 
+    return correct;
 }
 
 void print_tree(tree_data trees[N_TREES][N_NODE_AND_LEAFS]){
@@ -202,40 +277,264 @@ void print_tree(tree_data trees[N_TREES][N_NODE_AND_LEAFS]){
 
 }
 
-void train_model(tree_data trees_population[POPULATION][N_TREES][N_NODE_AND_LEAFS], 
-                    token_t *buf, struct feature *features, int read_samples, 
-                    float *accuracy, uint8_t sow_log, int32_t *trees_used, int n_classes){
-
-    uint32_t processed;
+/*
+ * Hits of the individual of rank p on the accelerator, which must already
+ * hold the shared trees. Only the N_BOOSTING trees of the active stage are
+ * uploaded; the features stay resident after the first burst, load_features
+ * is cleared once they are sent.
+ */
+int acc_fitness_range(struct population *population, int p, uint32_t boosting_i,
+                        token_t *trees_buf, token_t *buf, struct feature *features,
+                        int read_samples, uint8_t *predictions, uint8_t *load_features)
+{
+    uint32_t processed = 0;
     uint32_t burst;
     float exe_t;
-    uint8_t predictions[MAX_TEST_SAMPLES];
+
+    //print_tree(individual(population, p));
+    coppy_trees(individual(population, p), boosting_i * N_BOOSTING, N_BOOSTING, trees_buf);
+    send_trees(trees_buf, boosting_i * N_BOOSTING, N_BOOSTING);
+
+    while (processed < read_samples) {
+        burst =
+            (read_samples - processed) > MAX_BURST ? MAX_BURST : (read_samples - processed);
+        perform_inferences_hw(buf, &features[processed], 
+                                burst, &predictions[processed], &exe_t, *load_features);
+    
+        processed += burst;
+        *load_features = FALSE;
+    }
+
+    return count_correct(features, read_samples, predictions);
+}
+
+// Scores the individual of rank p on the accelerator, see acc_fitness_range()
+void acc_fitness_individual(struct population *population, int p, uint32_t boosting_i,
+                            token_t *trees_buf, token_t *buf, struct feature *features,
+                            int read_samples, uint8_t *predictions, uint8_t *load_features)
+{
+    int correct = acc_fitness_range(population, p, boosting_i, trees_buf, buf, features,
+                                    read_samples, predictions, load_features);
+
+    population->accuracy[p] = (float) correct / (float) read_samples;
+}
+
+/*
+ * The shared trees are loaded once into the accelerator, then only the
+ * N_BOOSTING trees of the active stage are uploaded for every individual
+ * listed in ranks.
+ */
+void train_model(struct population *population, uint32_t boosting_i,
+                    token_t *trees_buf, token_t *buf, struct feature *features, int read_samples, 
+                    uint8_t sow_log, int32_t *trees_used, int n_classes,
+                    const int *ranks, int n_ranks){
+
+    uint8_t *predictions = malloc(read_samples);
 
     u_int8_t load_features = TRUE;
 
+    coppy_trees(population->frozen, 0, N_TREES, trees_buf);
+    send_trees(trees_buf, 0, N_TREES);
     
-    for (int p = 0; p < POPULATION; p++){
+    for (int i = 0; i < n_ranks; i++){
+        acc_fitness_individual(population, ranks[i], boosting_i, trees_buf, buf, features,
+                                read_samples, predictions, &load_features);
+    }
 
-        processed = 0;
-        
-        //print_tree(trees_population[p]);
-        coppy_trees(trees_population[p], buf);
-        send_trees(buf);
-
-        while (processed < read_samples) {
-            burst =
-                (read_samples - processed) > MAX_BURST ? MAX_BURST : (read_samples - processed);
-            perform_inferences_hw(buf, &features[processed], 
-                                    burst, &predictions[processed], &exe_t, load_features);
-        
-            processed += burst;
-            load_features = FALSE;
+    free(predictions);
+}
+
+/*
+ * Hybrid backend: OpenMP thread 0 drives the accelerator and the other
+ * threads evaluate on the CPU, all of them taking the listed ranks from the
+ * same work_queue until it is drained.
+ */
+void train_model_hybrid(struct work_queue *queue, struct cpu_fitness *cpu,
+                        struct population *population, uint32_t boosting_i,
+                        token_t *trees_buf, token_t *buf, struct feature *features,
+                        int read_samples, const int *ranks, int n_ranks)
+{
+    uint8_t *predictions = malloc(read_samples);
+    u_int8_t load_features = TRUE;
+
+    cpu_fitness_prepare(cpu, population->frozen, boosting_i, features, read_samples);
+    coppy_trees(population->frozen, 0, N_TREES, trees_buf);
+    send_trees(trees_buf, 0, N_TREES);
+
+    #pragma omp parallel
+    {
+        enum worker_kind kind = omp_get_thread_num() == 0 ? WORKER_ACC : WORKER_CPU;
+        int i;
+
+        // Sized from the team really running, which may be smaller than the maximum
+        #pragma omp single
+        work_queue_reset(queue, n_ranks, 1, omp_get_num_threads() - 1);
+
+        while ((i = work_queue_claim(queue, kind)) >= 0) {
+            double start = omp_get_wtime();
+            int p = ranks[i];
+
+            if (kind == WORKER_ACC) {
+                acc_fitness_individual(population, p, boosting_i, trees_buf, buf, features,
+                                        read_samples, predictions, &load_features);
+            } else {
+                population->accuracy[p] = cpu_fitness_individual(cpu, individual(population, p));
+            }
+
+            work_queue_done(queue, kind, (omp_get_wtime() - start) * 1000);
         }
+    }
 
-        get_accuracy(features, read_samples, predictions, &accuracy[p]);
+    printf("Hybrid: acc %i individuals %f ms each, cpu %i individuals %f ms each\n",
+            queue->done[WORKER_ACC], queue->latency_ms[WORKER_ACC],
+            queue->done[WORKER_CPU], queue->latency_ms[WORKER_CPU]);
 
+    free(predictions);
+}
+
+/*
+ * Racing version of evaluate_population(). Every round scores the ranks
+ * still racing on the next slice of the samples, with the same backends,
+ * then race_prune() drops the ones that cannot reach the elites. The
+ * accelerator loads each slice once and keeps it for all the ranks.
+ */
+void race_population(struct race *race, enum fitness_backend backend, struct cpu_fitness *cpu,
+                        struct work_queue *queue, struct population *population,
+                        uint32_t boosting_i, token_t *trees_buf, token_t *buf,
+                        struct feature *features, int read_samples, const int *ranks,
+                        int n_ranks)
+{
+    uint8_t *predictions = malloc(read_samples);
+    int begin = 0;
+
+    if (backend != FITNESS_ACC)
+        cpu_fitness_prepare(cpu, population->frozen, boosting_i, features, read_samples);
+    if (backend != FITNESS_CPU) {
+        coppy_trees(population->frozen, 0, N_TREES, trees_buf);
+        send_trees(trees_buf, 0, N_TREES);
     }
 
+    race_start(race, read_samples, ranks, n_ranks);
+    for (int round = 0; round < RACE_ROUNDS; round++) {
+        int end = race_prefix(race, round);
+        int n = end - begin;
+        u_int8_t load_features = TRUE;
+
+        if (n == 0)
+            continue;
+
+        if (backend == FITNESS_ACC) {
+            for (int i = 0; i < race->n_alive; i++) {
+                int p = race->alive[i];
+                race_score(race, p, acc_fitness_range(population, p, boosting_i, trees_buf,
+                                                        buf, &features[begin], n, predictions,
+                                                        &load_features), n);
+            }
+        } else if (backend == FITNESS_CPU) {
+            #pragma omp parallel for schedule(dynamic)
+            for (int i = 0; i < race->n_alive; i++) {
+                int p = race->alive[i];
+                race_score(race, p, cpu_fitness_range(cpu, individual(population, p),
+                                                        begin, end), n);
+            }
+        } else {
+            #pragma omp parallel
+            {
+                enum worker_kind kind = omp_get_thread_num() == 0 ? WORKER_ACC : WORKER_CPU;
+                int i;
+
+                #pragma omp single
+                work_queue_reset(queue, race->n_alive, 1, omp_get_num_threads() - 1);
+
+                while ((i = work_queue_claim(queue, kind)) >= 0) {
+                    double start = omp_get_wtime();
+                    int p = race->alive[i];
+                    int correct;
+
+                    if (kind == WORKER_ACC) {
+                        correct = acc_fitness_range(population, p, boosting_i, trees_buf, buf,
+                                                    &features[begin], n, predictions,
+                                                    &load_features);
+                    } else {
+                        correct = cpu_fitness_range(cpu, individual(population, p), begin, end);
+                    }
+                    race_score(race, p, correct, n);
+
+                    // Latencies are kept per whole set of samples, whatever the slice
+                    work_queue_done(queue, kind,
+                                    (omp_get_wtime() - start) * 1000 * read_samples / n);
+                }
+            }
+        }
+
+        race_prune(race, population);
+        begin = end;
+    }
+
+    printf("Race: %i of %i individuals scored on all the samples, %f of the full evaluation\n",
+            race->n_alive, n_ranks,
+            (double) race->sample_evals / ((double) POPULATION * read_samples));
+
+    free(predictions);
+}
+
+/*
+ * Scores the population on the accelerator, with train_model(), on the
+ * host cores, where the votes of the frozen trees are counted once and the
+ * individuals are spread over the OpenMP threads, or on both. With a race
+ * only the individuals that can still be elites see all the samples. The
+ * individuals found in the cache are not scored again.
+ */
+void evaluate_population(enum fitness_backend backend, struct cpu_fitness *cpu,
+                            struct work_queue *queue, struct race *race,
+                            struct fitness_cache *cache, struct population *population,
+                            uint32_t boosting_i, token_t *trees_buf, token_t *buf,
+                            struct feature *features, int read_samples, int32_t *trees_used,
+                            int n_classes)
+{
+    int ranks[POPULATION];
+    int n_ranks = fitness_cache_lookup(cache, population, ranks);
+
+    printf("Fitness cache: %i of %i individuals already scored\n", cache->hits, POPULATION);
+    if (n_ranks == 0)
+        return;
+
+    if (race != NULL) {
+        race_population(race, backend, cpu, queue, population, boosting_i, trees_buf, buf,
+                        features, read_samples, ranks, n_ranks);
+        // The individuals dropped from the race only have the accuracy of a prefix
+        fitness_cache_store(cache, population, race->alive, race->n_alive);
+        return;
+    }
+
+    if (backend == FITNESS_HYBRID) {
+        train_model_hybrid(queue, cpu, population, boosting_i, trees_buf, buf, features,
+                            read_samples, ranks, n_ranks);
+    } else if (backend == FITNESS_CPU) {
+        cpu_fitness_prepare(cpu, population->frozen, boosting_i, features, read_samples);
+        cpu_fitness_population(cpu, population, ranks, n_ranks);
+    } else {
+        train_model(population, boosting_i, trees_buf, buf, features, read_samples,
+                    0, trees_used, n_classes, ranks, n_ranks);
+    }
+    fitness_cache_store(cache, population, ranks, n_ranks);
+}
+
+// Evaluates and prints the accuracy of the frozen model
+void evaluate_frozen(enum fitness_backend backend, tree_t *frozen, token_t *trees_buf,
+                        token_t *buf, struct feature *features, int read_samples, int n_classes,
+                        uint8_t *predictions, uint8_t new_features)
+{
+    float exe_time_ms;
+
+    if (backend == FITNESS_CPU) {
+        cpu_predict(frozen, features, read_samples, predictions);
+        print_accuracy(features, predictions, read_samples, n_classes);
+    } else {
+        coppy_trees(frozen, 0, N_TREES, trees_buf);
+        evaluate_model(trees_buf, buf, features, read_samples, n_classes,
+                        predictions, MAX_BURST, &exe_time_ms, new_features);
+    }
 }
 
 void export_model(tree_data trees[N_TREES][N_NODE_AND_LEAFS], const char* filename) {
@@ -269,53 +568,101 @@ void show_logs(float population_accuracy[POPULATION]){
 int main(int argc, char **argv)
 {
     token_t *buf;
-    uint8_t predictions[MAX_TEST_SAMPLES];
+    token_t *trees_buf;
+    uint8_t *predictions;
     int n_classes;
     int n_features;
     int read_samples;
-    float exe_time_ms_hw;
     struct timespec startn, endn;
     unsigned long long sw_ns;
 
-    float population_accuracy[POPULATION] = {0};
     float iteration_accuracy[MEMORY_ACU_SIZE] = {0};
     float mutation_factor = 0;
     float max_features[N_FEATURE] = {0};
     float min_features[N_FEATURE] = {0};
     float class_100x100[256] = {0};
 
-    struct feature features[MAX_TEST_SAMPLES];
-    struct feature features_augmented[MAX_TEST_SAMPLES*10];
+    struct feature *features;
+    struct feature *features_augmented;
+    int augmentation_factor = 0;
     int ite_no_impru = 0;
     uint32_t used_trees = 0;
     uint32_t used_trees_test = 0;
     int generation_ite = 0;
 
-    tree_data trees_population[POPULATION][N_TREES][N_NODE_AND_LEAFS] = {0};
-    tree_data golden_tree[N_TREES][N_NODE_AND_LEAFS] = {0};
-
-    for (int p = 0; p < POPULATION; p++)
-        initialize_trees(trees_population[p]);
-        
-    initialize_trees(golden_tree);
+    struct population population;
+    struct rng data_rng;
+    struct cpu_fitness cpu_fitness;
+    struct work_queue work_queue = {0};
+    struct race race;
+    struct fitness_cache fitness_cache;
+    int racing = FALSE;
+    enum fitness_backend backend = FITNESS_ACC;
+    int opt;
+
+    static const struct option long_options[] = {
+        {"seed", required_argument, NULL, 's'},
+        {"backend", required_argument, NULL, 'b'},
+        {"race", no_argument, NULL, 'r'},
+        {NULL, 0, NULL, 0}
+    };
+
+    // population.frozen holds the golden model: the trees of the finished stages
+    if (alloc_population(&population)) {
+        printf("Out of memory for a population of %i\n", POPULATION);
+        return 1;
+    }
 
-    srand(clock());
+    // Without --seed the run is seeded from the clock, the seed is printed to repeat it
+    population.seed = time(NULL);
+    while ((opt = getopt_long(argc, argv, "s:b:r", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 's':
+            population.seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'b':
+            if (!strcmp(optarg, "acc")) {
+                backend = FITNESS_ACC;
+                break;
+            } else if (!strcmp(optarg, "cpu")) {
+                backend = FITNESS_CPU;
+                break;
+            } else if (!strcmp(optarg, "hybrid")) {
+                backend = FITNESS_HYBRID;
+                break;
+            }
+            printf("Unknown fitness backend %s, use acc, cpu or hybrid\n", optarg);
+            return 1;
+        case 'r':
+            racing = TRUE;
+            break;
+        default:
+            printf("Train use : %s [--seed n] [--backend acc|cpu|hybrid] [--race] "
+                    "<dataset.csv|dataset.bin> \n", argv[0]);
+            return 1;
+        }
+    }
+    rng_init(&data_rng, population.seed, (uint64_t)RNG_SHUFFLE << 24);
 
-    // Validación de los argumentos: se esperan dos argumentos (dataset y modelo)
-    if (argc < 2) {
-        printf("Train use : %s <dataset.csv> \n", argv[0]);
+    // Validación de los argumentos: se espera el dataset
+    if (argc - optind < 1) {
+        printf("Train use : %s [--seed n] [--backend acc|cpu|hybrid] [--race] "
+                "<dataset.csv|dataset.bin> \n", argv[0]);
         return 1;
     }
 
-    printf("\nTrain mode 1 ====== %s ======\n\n", cfg_000[0].devname);
+    printf("\nTrain mode 1 ====== %s ======\n\n",
+            backend == FITNESS_CPU ? "cpu" : cfg_000[0].devname);
+    printf("Random seed %llu on %i threads\n", (unsigned long long)population.seed,
+            omp_get_max_threads());
 
     // Cargar dataset desde el archivo recibido por línea de comandos
-    printf("Cargando features desde %s...\n", argv[1]);
-    read_samples = read_n_features(argv[1], MAX_TEST_SAMPLES, features, &n_features);
-    n_features--; // remove predictions
-    if (read_samples < 0) {
+    printf("Cargando features desde %s...\n", argv[optind]);
+    features = read_n_features(argv[optind], &read_samples, &n_features);
+    if (features == NULL) {
         return 1;
     }
+    n_features--; // remove predictions
 
     find_max_min_features(features, max_features, min_features, read_samples);
     find_n_classes(features, &n_classes, read_samples);
@@ -323,71 +670,94 @@ int main(int argc, char **argv)
     printf("Num features_read from the dataset %i\n", read_samples);
     printf("Num n_features from the dataset %i\n", n_features);
 
+    features_augmented = malloc(sizeof(struct feature) * read_samples * (augmentation_factor + 1));
+    predictions = malloc(read_samples);
+    if (features_augmented == NULL || predictions == NULL) {
+        printf("Out of memory for %i samples\n", read_samples);
+        return 1;
+    }
+
     read_samples = augment_features(features, read_samples, n_features, 
                                     max_features, min_features, features_augmented,
-                                    MAX_TEST_SAMPLES*10, 0);
+                                    read_samples * (augmentation_factor + 1),
+                                    augmentation_factor, population.seed);
+    free(features);
 
     read_samples /= 10; // reduce the amount of samples
 
     init_parameters();
+    fitness_cache_init(&fitness_cache);
 
-    buf = (token_t *)esp_alloc(size);
+    // The CPU backend does not touch the accelerator, not even for its buffers
+    if (backend != FITNESS_ACC && cpu_fitness_init(&cpu_fitness, read_samples * 80/100)) {
+        printf("Out of memory for the CPU evaluator\n");
+        return 1;
+    }
+    if (backend == FITNESS_CPU) {
+        buf = NULL;
+        trees_buf = NULL;
+    } else {
+        buf = (token_t *)esp_alloc(size);
+        trees_buf = (token_t *)esp_alloc(sizeof(token_t) * N_TREES * N_NODE_AND_LEAFS);
+    }
 
     for (size_t boosting_i = 0; boosting_i < N_TREES / N_BOOSTING; boosting_i++){
         used_trees = (boosting_i + 1)*N_BOOSTING;
         generation_ite = 0;
-        shuffle(features_augmented, read_samples);
+        shuffle(features_augmented, read_samples, &data_rng);
+        // Every stage trains on other samples and on more frozen trees
+        fitness_cache_new_epoch(&fitness_cache);
 
-        for (uint32_t p = 0; p < POPULATION; p++)
-            generate_random_trees(trees_population[p], n_features, boosting_i,
-                                    max_features, min_features, n_classes);
+        generate_population(&population, n_features, max_features, min_features, n_classes);
 
         while(1){
             gettime(&startn);
-            train_model(trees_population, buf, features_augmented, 
-                            read_samples * 80/100, population_accuracy, 
-                            0, &used_trees, n_classes);
+            evaluate_population(backend, &cpu_fitness, &work_queue, racing ? &race : NULL,
+                                &fitness_cache, &population, boosting_i, trees_buf, buf,
+                                features_augmented, read_samples * 80/100, &used_trees,
+                                n_classes);
             gettime(&endn);
             sw_ns = ts_subtract(&startn, &endn);
             printf("Infe\t\t time: %f s\n", sw_ns/1000000000.0);
         
             gettime(&startn);
-            reorganize_population(population_accuracy, trees_population, used_trees);
+            reorganize_population(&population);
             gettime(&endn);
             sw_ns = ts_subtract(&startn, &endn);
             printf("reorganize\t time: %f s\n", sw_ns/1000000000.0);
 
             /////////////////////////////// tests ///////////////////////////////
-            show_logs(population_accuracy);
+            show_logs(population.accuracy);
             // evaluation features from out the training dataset
             printf("Boosting iteration %i of %i\n", boosting_i, N_TREES / N_BOOSTING);
             used_trees_test = used_trees - N_BOOSTING; // number of trees used on the previous iteration
             if (used_trees_test > 0){
-                coppy_trees(golden_tree, buf);
-                evaluate_model(buf, features_augmented, read_samples, n_classes, 
-                                        predictions, MAX_BURST, &exe_time_ms_hw, FALSE);
+                // Racing and the cache leave other samples resident, reload them
+                evaluate_frozen(backend, population.frozen, trees_buf, buf,
+                                features_augmented, read_samples, n_classes, predictions, TRUE);
             }
             /////////////////////////////////////////////////////////////////////
             
             gettime(&startn);
-            if(population_accuracy[0] >= 1 || ite_no_impru > MAX_NO_IMPRU){
+            if(population.accuracy[0] >= 1 || ite_no_impru > MAX_NO_IMPRU){
                 ite_no_impru = 0;
-                shuffle(features_augmented, read_samples* 80/100);
+                shuffle(features_augmented, read_samples* 80/100, &data_rng);
                 for (int accuracy_i = 0; accuracy_i < MEMORY_ACU_SIZE; accuracy_i++){
                     iteration_accuracy[accuracy_i] = 0;
                 }
                 break;
             }
 
-            mutate_population(trees_population, population_accuracy, max_features,
-                                min_features, n_features, mutation_factor, boosting_i, n_classes,
+            mutate_population(&population, max_features,
+                                min_features, n_features, mutation_factor, n_classes,
                                 class_100x100);
 
-            crossover(trees_population, boosting_i);
+            crossover(&population);
 
+            population.generation++;
             generation_ite ++;
             mutation_factor = 0;
-            iteration_accuracy[generation_ite % MEMORY_ACU_SIZE] = population_accuracy[0];
+            iteration_accuracy[generation_ite % MEMORY_ACU_SIZE] = population.accuracy[0];
             for (int accuracy_i = 0; accuracy_i < MEMORY_ACU_SIZE; accuracy_i++){
                 if(iteration_accuracy[generation_ite % MEMORY_ACU_SIZE] <= iteration_accuracy[accuracy_i]){
                     if ((generation_ite % MEMORY_ACU_SIZE) != accuracy_i){
@@ -409,26 +779,26 @@ int main(int argc, char **argv)
             printf("Rest\t\t time: %f s\n", sw_ns/1000000000.0);
         }
 
-        // coppy the amount of trees trained up to this point
-        for (uint32_t tree_i = 0; tree_i < used_trees; tree_i++){
-            memcpy(golden_tree[tree_i], trees_population[0][tree_i], sizeof(tree_data) * N_NODE_AND_LEAFS);
-        }
-        for (uint32_t p = 1; p < POPULATION; p++){
-            for (uint32_t tree_i = 0; tree_i < N_TREES; tree_i++){
-                memcpy(trees_population[p][tree_i], trees_population[0][tree_i], sizeof(tree_data) * N_NODE_AND_LEAFS);
-            }
-        }
+        // the trees of this stage are now shared by every individual
+        freeze_stage(&population, boosting_i);
     }
 
     printf("Final evaluation !!!!\n\n");
-    coppy_trees(golden_tree, buf);
-    evaluate_model(buf, features_augmented, read_samples, n_classes, 
-        predictions, MAX_BURST, &exe_time_ms_hw, TRUE);
+    evaluate_frozen(backend, population.frozen, trees_buf, buf, features_augmented,
+                    read_samples, n_classes, predictions, TRUE);
 
     printf("Exporting model\n");
-    export_model(golden_tree, "model.bin");
+    export_model(population.frozen, "model.bin");
 
-    esp_free(buf);
+    if (backend != FITNESS_ACC)
+        cpu_fitness_free(&cpu_fitness);
+    if (backend != FITNESS_CPU) {
+        esp_free(buf);
+        esp_free(trees_buf);
+    }
+    free_population(&population);
+    free(features_augmented);
+    free(predictions);
 
     return 0;
 }
\ No newline at end of file
@@ -1,20 +1,22 @@
 module tree #(
     parameter N_NODE_AND_LEAFS = 256,
-    parameter N_FEATURE        = 32
+    parameter N_FEATURE        = 32,
+    parameter N_INFLIGHT       = 2      // muestras recorridas a la vez, intercaladas ciclo a ciclo
 ) (
     input  logic                                    clk,
     input  logic                                    rst_n,
     input  logic                                    start,
+    input  logic [N_INFLIGHT-1:0]                   valid,          // muestras presentes en este start
     input  logic signed [31:0]                      feature,
     output logic [$clog2(N_FEATURE)-1:0]            feature_index,
-    input  logic [63:0]                             node,
+    output logic [$clog2(N_INFLIGHT > 1 ? N_INFLIGHT : 2)-1:0] feature_sample,
+    input  logic [63:0]                             node,           // nodo de node_index, leído en el flanco anterior
     output logic [$clog2(N_NODE_AND_LEAFS)-1:0]     node_index,
-    output logic [31:0]                             leaf_value,
+    output logic [N_INFLIGHT-1:0][31:0]             leaf_value,
     output logic                                    done
 );
 
-    typedef enum logic[1:0] { IDLE, FETCH_NODE, PROCESS, DONE} tree_state;
-    tree_state tree_st;
+    localparam SAMPLE_W = $clog2(N_INFLIGHT > 1 ? N_INFLIGHT : 2);
 
     typedef struct packed {
         logic signed [31:0]     value;                  // Value for leaf (0) or threshold for node (1)
@@ -25,58 +27,78 @@ module tree #(
         logic                   leaf_or_node;           // 0 for leaf, 1 for node
     } tree_camps_t;
 
-    tree_camps_t camps;
+    /*
+     * Barrel engine: every cycle the BRAM is read for the sample pointed by
+     * turn (FETCH) while the node read the cycle before is resolved for its
+     * own sample (PROCESS). A sample is never in both stages at once, so with
+     * N_INFLIGHT >= 2 the read port is busy every cycle, and with
+     * N_INFLIGHT = 1 it walks like the old two-state FSM.
+     * The FETCH register is the output register of the BRAM read, so node
+     * already holds the node asked for on node_index the cycle before.
+     */
+    tree_camps_t                                camps;          // nodo leído, etapa PROCESS
+    logic                                       camps_valid;
+    logic [SAMPLE_W-1:0]                        camps_sample;
+    logic [N_INFLIGHT-1:0][$clog2(N_NODE_AND_LEAFS)-1:0] sample_node;   // nodo actual de cada muestra
+    logic [N_INFLIGHT-1:0]                      walking;
+    logic [SAMPLE_W-1:0]                        turn;
+    logic                                       fetch;
+    logic                                       running;
+
+    always_comb begin
+        fetch      = walking[turn] && !(camps_valid && camps_sample == turn);
+        node_index = sample_node[turn];
+    end
 
     always_ff @(posedge clk or negedge rst_n) begin
         if (!rst_n) begin
-            tree_st <= IDLE;
-            node_index <= 0;
-            leaf_value <= 0;
-            done <= 0;
+            sample_node  <= '0;
+            walking      <= '0;
+            turn         <= 0;
+            camps_valid  <= 0;
+            camps_sample <= 0;
+            leaf_value   <= '0;
+            running      <= 0;
+            done         <= 0;
+        end else if (start) begin
+            sample_node  <= '0;
+            walking      <= valid;
+            turn         <= 0;
+            camps_valid  <= 0;
+            leaf_value   <= '0;
+            running      <= 1;
+            done         <= 0;
         end else begin
-            case (tree_st)
-                IDLE: begin
-                    if (start) begin
-                        tree_st <= FETCH_NODE;
-                        node_index <= 0;
-                        leaf_value <= 0;
-                        done <= 0;
-                    end
-                end
+            // FETCH: lectura del nodo de la muestra de este turno
+            camps_valid  <= fetch;
+            camps_sample <= turn;
+            turn <= (turn == N_INFLIGHT-1) ? 0 : turn + 1;
 
-                FETCH_NODE: begin
-                    tree_st <= PROCESS;
-                    camps <= tree_camps_t'(node);
+            // PROCESS: el nodo leído el ciclo anterior
+            if (camps_valid) begin
+                if (camps.leaf_or_node == 0) begin
+                    // It's a leaf node, return the leaf value
+                    leaf_value[camps_sample] <= camps.value;
+                    walking[camps_sample]    <= 0;
+                end else if (feature < camps.value) begin
+                    sample_node[camps_sample] <= sample_node[camps_sample] + 1;
+                end else begin
+                    sample_node[camps_sample] <= camps.next_node_right_index;
                 end
+            end
 
-                PROCESS: begin
-                    // Process the current node
-                    if (camps.leaf_or_node == 0) begin
-                        // It's a leaf node, return the leaf value
-                        leaf_value <= camps.value;
-                        tree_st <= DONE;
-                    end else begin
-                        // It's a decision node, update feature index and node index
-                        if (feature < camps.value) begin
-                            node_index <= node_index +1;
-                        end else begin
-                            node_index <= camps.next_node_right_index;
-                        end
-                        tree_st <= FETCH_NODE;
-                    end
-
-                end
-
-                DONE: begin
-                    done <= 1; // Indicate processing is done
-                    tree_st <= IDLE; // Reset state for next operation
-                end
-
-                default: tree_st <= IDLE; // Fallback to IDLE state
-            endcase
+            // Sin muestras recorriendo tampoco queda ningún nodo en PROCESS
+            if (running && walking == 0) begin
+                running <= 0;
+                done    <= 1;
+            end
         end
     end
 
-    always_comb feature_index = camps.f_index;
+    always_comb begin
+        camps          = tree_camps_t'(node);
+        feature_index  = camps.f_index;
+        feature_sample = camps_sample;
+    end
 
-endmodule
\ No newline at end of file
+endmodule
@@ -3,7 +3,15 @@ module trees #(
 	parameter int N_NODE_AND_LEAFS = 256,
 	parameter int N_FEATURE        = 32,
 	parameter int N_CLASES         = 32,
-	parameter int UNROLL	       = 8
+	parameter int UNROLL	       = 8,
+	parameter int N_INFLIGHT       = 2,		// muestras recorridas a la vez por cada árbol
+	parameter int ARGMAX           = 1,		// 0: barrido de una clase por ciclo, 1: árbol de
+											// comparadores, 2: árbol con un registro por nivel
+	parameter int DUAL_PORT        = 0,		// 1: dos motores por BRAM, uno en cada puerto de
+											// lectura, con N_INFLIGHT/2 muestras cada uno
+											// (N_INFLIGHT par)
+	parameter int EARLY_EXIT       = 0		// 1: cerrar la votación en cuanto el ganador no
+											// pueda cambiar (requiere ARGMAX = 1)
 )(
 	input  logic                          		clk,
 	input  logic                          		rst_n,
@@ -15,13 +23,17 @@ module trees #(
 	input  logic [$clog2(N_TREES)-1:0]         	n_tree,
 	input  logic [63:0]                   		tree_nodes,
 
-	// Características de entrada
-	input  logic [N_FEATURE-1:0][31:0]    		features,
+	// Características de entrada, una fila por muestra; las válidas ocupan
+	// los primeros slots
+	input  logic [N_INFLIGHT-1:0][N_FEATURE-1:0][31:0] features,
+	input  logic [N_INFLIGHT-1:0]         		valid,
+	input  logic                          		vote_counts,	// se leen los votos: se cuentan todos los árboles
 
-	// Salida final
+	// Salida final, una muestra tras otra, cada una con su pulso de done
 	output logic [7:0]                    		prediction,
+	output logic [N_CLASES-1:0][7:0]      		votes,			// votos por clase, válidos con done
 	output logic                          		done,
-	output logic                          		idle_sys
+	output logic                          		idle_sys		// los árboles aceptan un nuevo start
 );
 
 	// ----------------------------------------------------------------
@@ -31,14 +43,22 @@ module trees #(
 	localparam int N_CLASES_W = $clog2(N_CLASES);
 	localparam int CNT_W      = $clog2(N_TREES+1);
 	localparam int N_NODE_W   = $clog2(N_NODE_AND_LEAFS);
+	localparam int SAMPLE_W   = $clog2(N_INFLIGHT > 1 ? N_INFLIGHT : 2);
+	localparam int N_PORTS    = DUAL_PORT ? 2 : 1;
+	localparam int PORT_INFLIGHT = N_INFLIGHT / N_PORTS;		// muestras de cada motor
+	localparam int PORT_SAMPLE_W = $clog2(PORT_INFLIGHT > 1 ? PORT_INFLIGHT : 2);
+	localparam int ARGMAX_LEVELS  = $clog2(N_CLASES);
+	localparam int ARGMAX_LEAVES  = 1 << ARGMAX_LEVELS;
+	localparam int ARGMAX_LATENCY = (ARGMAX == 2) ? ARGMAX_LEVELS : 0;	// ciclos en VS_VOTE
 
 	// ----------------------------------------------------------------
 	//  Señales para el ensamble de árboles
 	// ----------------------------------------------------------------
-	logic [31:0]               leaf_vals   [0:N_TREES-1];
+	logic [N_INFLIGHT-1:0][31:0] leaf_vals [0:N_TREES-1];
 	logic [N_TREES-1:0]        tree_done;
-	logic [FEAT_IDX_W-1:0]     feature_idx [0:N_TREES-1];
-	logic [N_NODE_W-1:0]       node_idx    [0:N_TREES-1];
+	logic [FEAT_IDX_W-1:0]     feature_idx [0:N_TREES-1][0:N_PORTS-1];
+	logic [PORT_SAMPLE_W-1:0]  feature_smp [0:N_TREES-1][0:N_PORTS-1];
+	logic [N_NODE_W-1:0]       node_idx    [0:N_TREES-1][0:N_PORTS-1];
 
 	// ----------------------------------------------------------------
 	//  Contadores para votación
@@ -49,50 +69,103 @@ module trees #(
 	logic [7:0]                value_pred;
 	logic [CNT_W-1:0]          cnt_trees;
 	logic [N_CLASES_W-1:0]     cnt_vote;
+	logic [SAMPLE_W-1:0]       cnt_sample;		// muestra que se está votando
+	logic [N_INFLIGHT-1:0]     valid_ff;		// muestras que recorren los árboles
+
+	// Niveles del árbol de argmax, el nivel 0 son los votos de cada clase
+	logic [CNT_W-1:0]          am_cnt [0:ARGMAX_LEVELS][0:ARGMAX_LEAVES-1];
+	logic [N_CLASES_W-1:0]     am_idx [0:ARGMAX_LEVELS][0:ARGMAX_LEAVES-1];
+
+	// Votación anticipada: árboles aún sin contar y si el líder ya es fijo
+	logic [CNT_W-1:0]          remaining;
+	logic                      decided;
+
+	// Hojas latcheadas de las muestras que se votan, los árboles ya
+	// recorren las siguientes
+	logic [N_INFLIGHT-1:0][31:0] leaf_q [0:N_TREES-1];
+	logic [N_INFLIGHT-1:0]     valid_q;
+	logic                      hand_over;
+
+	// Hoja de cada árbol que se cuenta en este ciclo de VS_COUNT
+	logic signed [31:0]        leaf_cnt [UNROLL-1:0];
 
 	// FSM de control de votación
-	typedef enum logic [1:0] { VS_IDLE, VS_COUNT, VS_VOTE, VS_SELECT } vote_st_t;
+	typedef enum logic [2:0] { VS_IDLE, VS_COUNT, VS_VOTE, VS_SELECT, VS_NEXT } vote_st_t;
 	vote_st_t vote_st;
 	logic     start_ff;
 
 	// ----------------------------------------------------------------
 	//  Instanciación de N_TREES BRAMs y motores tree
 	// ----------------------------------------------------------------
-	genvar t;
+	genvar t, p;
 	generate
+		// Cada motor del puerto dual recorre la mitad de los slots
+		if (DUAL_PORT && N_INFLIGHT % 2) begin : GEN_CHECK_PORTS
+			$error("trees: DUAL_PORT necesita N_INFLIGHT par (N_INFLIGHT = %0d)", N_INFLIGHT);
+		end
+
+		// El corte compara contra el líder del árbol de comparadores combinacional
+		if (EARLY_EXIT && ARGMAX != 1) begin : GEN_CHECK_EARLY
+			$error("trees: EARLY_EXIT necesita ARGMAX = 1 (ARGMAX = %0d)", ARGMAX);
+		end
+
 		for (t = 0; t < N_TREES; t++) begin : GEN_TREES
 			// Cada árbol tiene su BRAM individual inferida
 			(* ram_style = "block" *)
 			logic [63:0] tree_mem_t [0:N_NODE_AND_LEAFS-1];
 
-			// Dato leído registrado
-			logic [63:0] tree_node_q;
+			// Dato leído por cada puerto, y hojas y done de cada motor
+			logic [63:0] tree_node_q [0:N_PORTS-1];
+			logic [N_PORTS-1:0][PORT_INFLIGHT-1:0][31:0] port_leaf;
+			logic [N_PORTS-1:0] port_done;
+			logic [N_NODE_W-1:0] addr_a;
+
+			// La carga y el recorrido nunca coinciden: el puerto A escribe
+			// durante la carga y después lee para el motor 0
+			always_comb addr_a = load_trees ? n_node : node_idx[t][0];
 
-			// Escritura y lectura síncronas en un solo always_ff
+			// Puerto A: escritura y lectura síncronas en un solo always_ff.
+			// La lectura registrada es la etapa FETCH del motor, así que
+			// se infiere como BRAM sin añadir ciclos
 			always_ff @(posedge clk) begin
-				// Escritura de nodos
 				if (load_trees && (n_tree == t))
-				  	tree_mem_t[n_node] <= tree_nodes;
+				  	tree_mem_t[addr_a] <= tree_nodes;
+				tree_node_q[0] <= tree_mem_t[addr_a];
+			end
+
+			// Puerto B: solo lectura síncrona, para el segundo motor
+			if (DUAL_PORT) begin : GEN_PORT_B
+				always_ff @(posedge clk)
+					tree_node_q[1] <= tree_mem_t[ node_idx[t][1] ];
+			end
+
+			// El motor p recorre los slots [p*PORT_INFLIGHT, (p+1)*PORT_INFLIGHT)
+			// y lee por su propio puerto de la BRAM
+			for (p = 0; p < N_PORTS; p++) begin : GEN_PORTS
+				// Instancia del árbol de decisión
+				tree #(
+					.N_NODE_AND_LEAFS(N_NODE_AND_LEAFS),
+					.N_FEATURE       (N_FEATURE),
+					.N_INFLIGHT      (PORT_INFLIGHT)
+				) tree_u (
+					.clk           (clk),
+					.rst_n         (rst_n),
+					.start         (start),
+					.valid         (valid[p*PORT_INFLIGHT +: PORT_INFLIGHT]),
+					.feature       (features[ p*PORT_INFLIGHT + feature_smp[t][p] ][ feature_idx[t][p] ]),
+					.feature_index (feature_idx[t][p]),
+					.feature_sample(feature_smp[t][p]),
+					.node          (tree_node_q[p]),
+					.node_index    (node_idx[t][p]),
+					.leaf_value    (port_leaf[p]),
+					.done          (port_done[p])
+				);
+			end
+
+			always_comb begin
+				leaf_vals[t] = port_leaf;
+				tree_done[t] = &port_done;
 			end
-		    
-		  	always_comb tree_node_q <= tree_mem_t[ node_idx[t] ];
-		  
-		    
-			// Instancia del árbol de decisión
-			tree #(
-				.N_NODE_AND_LEAFS(N_NODE_AND_LEAFS),
-				.N_FEATURE       (N_FEATURE)
-			) tree_u (
-				.clk           (clk),
-				.rst_n         (rst_n),
-				.start         (start),
-				.feature       (features[ feature_idx[t] ]),
-				.feature_index (feature_idx[t]),
-				.node          (tree_node_q),
-				.node_index    (node_idx[t]),
-				.leaf_value    (leaf_vals[t]),
-				.done          (tree_done[t])
-			);
 		end
 	endgenerate
 
@@ -105,7 +178,107 @@ module trees #(
 	end
 
 	// ----------------------------------------------------------------
-	//  FSM de salida: combinar done y generar prediction
+	//  Argmax en árbol: cada nodo compara dos clases y a igualdad se
+	//  queda con la de índice más bajo, la regla del > del barrido
+	// ----------------------------------------------------------------
+	genvar l, k;
+	generate
+		if (ARGMAX != 0) begin : GEN_ARGMAX
+			for (k = 0; k < ARGMAX_LEAVES; k++) begin : GEN_LEAF
+				// Las clases de relleno no tienen votos y nunca ganan
+				if (k < N_CLASES) begin : GEN_CLASS
+					always_comb am_cnt[0][k] = voted_trees_f[k];
+				end else begin : GEN_PAD
+					always_comb am_cnt[0][k] = '0;
+				end
+				always_comb am_idx[0][k] = k;
+			end
+
+			for (l = 0; l < ARGMAX_LEVELS; l++) begin : GEN_LEVEL
+				for (k = 0; k < (ARGMAX_LEAVES >> (l + 1)); k++) begin : GEN_NODE
+					logic take_hi;
+
+					always_comb take_hi = am_cnt[l][2*k+1] > am_cnt[l][2*k];
+
+					if (ARGMAX == 2) begin : GEN_PIPE
+						always_ff @(posedge clk) begin
+							am_cnt[l+1][k] <= take_hi ? am_cnt[l][2*k+1] : am_cnt[l][2*k];
+							am_idx[l+1][k] <= take_hi ? am_idx[l][2*k+1] : am_idx[l][2*k];
+						end
+					end else begin : GEN_COMB
+						always_comb begin
+							am_cnt[l+1][k] = take_hi ? am_cnt[l][2*k+1] : am_cnt[l][2*k];
+							am_idx[l+1][k] = take_hi ? am_idx[l][2*k+1] : am_idx[l][2*k];
+						end
+					end
+				end
+			end
+		end
+	endgenerate
+
+	// ----------------------------------------------------------------
+	//  Votación anticipada: en cada ciclo de VS_COUNT quedan remaining
+	//  árboles. El líder del árbol de argmax ya no puede perder si
+	//  ninguna otra clase, sumando todos los que quedan, lo supera ni lo
+	//  empata con índice más bajo. Así la predicción es la misma que
+	//  contando todos los árboles.
+	// ----------------------------------------------------------------
+	always_comb begin
+		remaining = N_TREES - cnt_trees * UNROLL;
+		decided   = 1;
+		for (int c = 0; c < N_CLASES; c++) begin
+			if (c != am_idx[ARGMAX_LEVELS][0]) begin
+				if ((CNT_W+1)'(voted_trees_f[c]) + remaining > am_cnt[ARGMAX_LEVELS][0] ||
+					((CNT_W+1)'(voted_trees_f[c]) + remaining == am_cnt[ARGMAX_LEVELS][0] &&
+					 c < am_idx[ARGMAX_LEVELS][0]))
+					decided = 0;
+			end
+		end
+	end
+
+	// Los contadores se limpian en VS_IDLE o VS_NEXT, un ciclo después de done
+	always_comb
+		for (int i = 0; i < N_CLASES; i++)
+			votes[i] = voted_trees_f[i];
+
+	// ----------------------------------------------------------------
+	//  Etapa de recorrido: cuando todos los árboles terminan y la
+	//  votación está libre, sus hojas pasan a leaf_q y los árboles
+	//  aceptan un nuevo start mientras se vota
+	// ----------------------------------------------------------------
+	always_comb begin
+		hand_over = start_ff && &tree_done && vote_st == VS_IDLE;
+		idle_sys  = !start_ff;
+	end
+
+	always_ff @(posedge clk or negedge rst_n) begin
+		if (!rst_n) begin
+			start_ff     <= 0;
+			valid_ff     <= 0;
+			valid_q      <= 0;
+		end else if (start) begin
+			start_ff     <= 1;
+			valid_ff     <= valid;
+		end else if (hand_over) begin
+			start_ff     <= 0;
+			valid_q      <= valid_ff;
+		end
+	end
+
+	always_ff @(posedge clk)
+		if (hand_over)
+			for (int i = 0; i < N_TREES; i++)
+				leaf_q[i] <= leaf_vals[i];
+
+	// Solo votan las hojas 0..N_CLASES-1, como en add_votes(). Los árboles
+	// de relleno de un modelo partido tienen hoja -1 y no cuentan
+	always_comb
+		for (int j = 0; j < UNROLL; j++)
+			leaf_cnt[j] = (cnt_trees + j * (N_TREES / UNROLL) < N_TREES) ?
+							leaf_q[cnt_trees + j * (N_TREES / UNROLL)][cnt_sample] : -1;
+
+	// ----------------------------------------------------------------
+	//  FSM de salida: votar las muestras de leaf_q y generar prediction
 	// ----------------------------------------------------------------
 	always_ff @(posedge clk or negedge rst_n) begin
 		if (!rst_n) begin
@@ -116,59 +289,81 @@ module trees #(
 			tmp_voted    <= 0;
 			cnt_trees    <= 0;
 			cnt_vote     <= 0;
-			start_ff     <= 0;
+			cnt_sample   <= 0;
 			vote_st      <= VS_IDLE;
 			done         <= 0;
-			idle_sys	 <= 1;
 		end else begin
 			case (vote_st)
 			VS_IDLE: begin
 				done         <= 0;
 				cnt_trees    <= 0;
-				idle_sys	 <= 1;
 				for (int j=0; j<UNROLL; ++j)
 					for (int i = 0; i < N_CLASES; i++)
 						voted_trees[j][i] <= 0;
-				if (start)
-					start_ff   <= 1;
-				if (start_ff && &tree_done) begin
-					idle_sys	 <= 0;
+				cnt_sample   <= 0;
+				if (hand_over)
 					vote_st    <= VS_COUNT;
-				end
 			end
 
 			VS_COUNT: begin
-				for (int j = 0; j < UNROLL; j++) begin
-					if (cnt_trees + j * (N_TREES / UNROLL) < N_TREES) begin
-						voted_trees[j][leaf_vals[cnt_trees + j * (N_TREES / UNROLL)]] <= 
-							voted_trees[j][leaf_vals[cnt_trees + j * (N_TREES / UNROLL)]] + 1;
+				if (EARLY_EXIT && ARGMAX == 1 && !vote_counts && decided) begin
+					// Los votos que quedan ya no cambian el ganador. Con
+					// vote_counts no se corta, votes debe llevar la cuenta
+					// completa porque reduce_votes() la suma entre trozos
+					value_pred <= am_idx[ARGMAX_LEVELS][0];
+					vote_st    <= VS_SELECT;
+				end else begin
+					for (int j = 0; j < UNROLL; j++) begin
+						if (leaf_cnt[j] >= 0 && leaf_cnt[j] < N_CLASES) begin
+							voted_trees[j][N_CLASES_W'(leaf_cnt[j])] <= 
+								voted_trees[j][N_CLASES_W'(leaf_cnt[j])] + 1;
+						end
+					end
+					cnt_trees <= cnt_trees + 1;
+					if (cnt_trees == (N_TREES / UNROLL) - 1) begin
+						cnt_vote   <= 0;
+						tmp_voted  <= 0;
+						value_pred <= 0;
+						vote_st    <= VS_VOTE;
 					end
-				end
-				cnt_trees <= cnt_trees + 1;
-				if (cnt_trees == (N_TREES / UNROLL) - 1) begin
-					cnt_vote   <= 0;
-					tmp_voted  <= 0;
-					value_pred <= 0;
-					vote_st    <= VS_VOTE;
 				end
 			end
 
 			VS_VOTE: begin
 				cnt_vote <= cnt_vote + 1;
-				if (voted_trees_f[cnt_vote] > tmp_voted) begin
-					tmp_voted   <= voted_trees_f[cnt_vote];
-					value_pred  <= cnt_vote;
-				end
-				if (cnt_vote == N_CLASES-1) begin
+				if (ARGMAX == 0) begin
+					if (voted_trees_f[cnt_vote] > tmp_voted) begin
+						tmp_voted   <= voted_trees_f[cnt_vote];
+						value_pred  <= cnt_vote;
+					end
+					if (cnt_vote == N_CLASES-1) begin
+						vote_st    <= VS_SELECT;
+					end
+				end else if (cnt_vote == ARGMAX_LATENCY) begin
+					// Los votos no cambian en VS_VOTE, el árbol ya los ha reducido
+					value_pred <= am_idx[ARGMAX_LEVELS][0];
 					vote_st    <= VS_SELECT;
 				end
 			end
 
 			VS_SELECT: begin
-				start_ff     <= 0;
 				prediction   <= value_pred;
 				done         <= 1;
-				vote_st      <= VS_IDLE;
+				if (cnt_sample != N_INFLIGHT-1 && valid_q[cnt_sample + 1])
+					vote_st    <= VS_NEXT;
+				else
+					vote_st    <= VS_IDLE;
+			end
+
+			// Siguiente muestra latcheada en leaf_q
+			VS_NEXT: begin
+				done         <= 0;
+				cnt_trees    <= 0;
+				cnt_sample   <= cnt_sample + 1;
+				for (int j=0; j<UNROLL; ++j)
+					for (int i = 0; i < N_CLASES; i++)
+						voted_trees[j][i] <= 0;
+				vote_st      <= VS_COUNT;
 			end
 			endcase
 		end
@@ -3,7 +3,13 @@ module trees_ping_pong #(
 	parameter N_NODE_AND_LEAFS 					= 256,
 	parameter N_FEATURE        					= 32,
 	parameter N_CLASES  		       			= 32,
-	parameter MAX_BURST        					= 5000
+	parameter MAX_BURST        					= 5000,
+	parameter VOTE_COUNTS      					= 0,		// 1: keep the per-class votes of every sample
+	parameter VOTE_WORDS       					= 4,		// 64-bit words of votes per sample, power of 2
+	parameter N_INFLIGHT       					= 2,		// samples each tree engine walks at once
+	parameter ARGMAX           					= 1,		// vote argmax: 0 scan, 1 comparator tree, 2 pipelined tree
+	parameter DUAL_PORT        					= 0,		// two tree engines per BRAM, one per read port (even N_INFLIGHT)
+	parameter EARLY_EXIT       					= 0			// stop counting once the winner is fixed (ARGMAX = 1)
 )(
     input  logic                                    	clk,
     input  logic                                    	rst_n,
@@ -18,16 +24,19 @@ module trees_ping_pong #(
     input  logic [$clog2(MAX_BURST*N_FEATURE/2)-1:0]	feature_addr,
     input  logic [$clog2(MAX_BURST):0]     				burst_len,
     input  logic [63:0]                             	features2,
+    input  logic                                    	vote_counts,		// votes are read, count every tree
 
     output logic [63:0]									prediction,
-    input  logic [$clog2(MAX_BURST):0]					prediction_addr,
+    output logic [63:0]									votes,
+    input  logic [$clog2(MAX_BURST*VOTE_WORDS):0]		prediction_addr,
     output logic										done
 );
 
 	localparam HALF_N_FEATURE     = N_FEATURE/2;
 	localparam MAX_BURST_BITS     = $clog2(MAX_BURST);
+	localparam SAMPLE_W           = $clog2(N_INFLIGHT > 1 ? N_INFLIGHT : 2);
 
-    typedef enum logic[1:0] { P_IDLE, P_PING, P_PONG, P_WAIT} process_state;
+    typedef enum logic { P_IDLE, P_RUN } process_state;
 	process_state proc_st;
 
     typedef enum logic[1:0] { C_IDLE, C_PING, C_PONG, C_WAIT} copy_state;
@@ -42,18 +51,29 @@ module trees_ping_pong #(
 
 	(* ram_style = "block" *) 
 	logic [63:0] 						features_mem [MAX_BURST*HALF_N_FEATURE-1:0];
-	logic [N_FEATURE-1:0][31:0] 		features_mux;
-	logic [HALF_N_FEATURE-1:0][63:0] 	features_ping;
-	logic [HALF_N_FEATURE-1:0][63:0] 	features_pong;
+	// Ping and pong hold N_INFLIGHT samples each, the trees walk them together
+	logic [N_INFLIGHT-1:0][N_FEATURE-1:0][31:0] 		features_mux;
+	logic [N_INFLIGHT-1:0]								valid_mux;
+	logic [N_INFLIGHT-1:0][HALF_N_FEATURE-1:0][63:0] 	features_ping;
+	logic [N_INFLIGHT-1:0][HALF_N_FEATURE-1:0][63:0] 	features_pong;
+	logic [N_INFLIGHT-1:0]								valid_ping;
+	logic [N_INFLIGHT-1:0]								valid_pong;
 	logic [$clog2(N_FEATURE)-1:0] 		feature_index;
+	logic [SAMPLE_W-1:0]				copy_sample;
 	logic [31:0] 						burst_index;
 
-	logic 								c_ping_ready;
-	logic 								c_pong_ready;
+	/*
+	A buffer is full while its filled and taken toggles differ. The copy
+	side flips filled when it has written the buffer, the process side
+	flips taken when it hands the buffer to the trees, so each flag has a
+	single driver and a buffer is never refilled before it is launched.
+	*/
+	logic 								ping_filled;
+	logic 								pong_filled;
 	logic 								c_ping_pong;
 
-	logic 								p_ping_ready;
-	logic 								p_pong_ready;
+	logic 								ping_taken;
+	logic 								pong_taken;
 	logic 								p_ping_pong;
 
 	logic 								start_set;
@@ -61,13 +81,19 @@ module trees_ping_pong #(
 
 	logic								load_predictions;
 
+	logic [N_CLASES-1:0][7:0]			votes_set;
+
 	logic 								idle_sys;
 
     trees #(
         .N_TREES(N_TREES),
         .N_NODE_AND_LEAFS(N_NODE_AND_LEAFS),
         .N_FEATURE(N_FEATURE),
-	    .N_CLASES(N_CLASES)
+	    .N_CLASES(N_CLASES),
+	    .N_INFLIGHT(N_INFLIGHT),
+	    .ARGMAX(ARGMAX),
+	    .DUAL_PORT(DUAL_PORT),
+	    .EARLY_EXIT(EARLY_EXIT)
 	)trees_u (
         .clk(clk),
         .rst_n(rst_n),
@@ -79,8 +105,11 @@ module trees_ping_pong #(
         .tree_nodes(tree_nodes),
 
         .features(features_mux),
+        .valid(valid_mux),
+        .vote_counts(vote_counts),
 
         .prediction(prediction_set),
+        .votes(votes_set),
         .done(done_set),
 		.idle_sys(idle_sys)
     );
@@ -100,10 +129,45 @@ module trees_ping_pong #(
 			prediction_mem[((prediction_index - 1) >> 3)] <= prediction_packed;
 
 	// ---------------------------------------------------
-	//  READ PREDICTIONS
+	//  READ PREDICTIONS, registered like a BRAM port:
+	//  prediction_addr leads the word by one cycle
+	// ---------------------------------------------------
+	always_ff @(posedge clk)
+		prediction <= prediction_mem[prediction_addr];
+
+	// ---------------------------------------------------
+	//  VOTE COUNTS: one row of VOTE_WORDS words per sample,
+	//  written when the ensemble finishes the sample.
+	//  MAX_BURST rows of VOTE_WORDS*64 bits, only built
+	//  for tiles of split models. The row read is
+	//  registered like the predictions one, the word is
+	//  picked from the registered row
 	// ---------------------------------------------------
-	always_comb
-		prediction = prediction_mem[prediction_addr];
+	generate
+		if (VOTE_COUNTS) begin : GEN_VOTES
+			(* ram_style = "block" *)
+			logic [VOTE_WORDS*64-1:0] 	votes_mem [MAX_BURST-1:0];
+			logic [VOTE_WORDS*64-1:0] 	votes_row;
+			logic [$clog2(VOTE_WORDS > 1 ? VOTE_WORDS : 2)-1:0]	votes_word;
+			logic 						votes_we;
+
+			always_comb votes_we = done_set && proc_st == P_RUN;
+
+			always_ff @(posedge clk)
+				if (votes_we)
+					votes_mem[prediction_index] <= (VOTE_WORDS*64)'(votes_set);
+
+			always_ff @(posedge clk) begin
+				votes_row  <= votes_mem[prediction_addr / VOTE_WORDS];
+				votes_word <= prediction_addr % VOTE_WORDS;
+			end
+
+			always_comb
+				votes = votes_row[votes_word*64 +: 64];
+		end else begin : GEN_NO_VOTES
+			always_comb votes = 64'd0;
+		end
+	endgenerate
 
 	// ---------------------------------------------------
 	//  COPY FEATURES PING PONG
@@ -111,20 +175,23 @@ module trees_ping_pong #(
 	always_ff @(posedge clk or negedge rst_n) begin
 		if (!rst_n) begin
 			copy_st <= C_IDLE;
-			p_ping_ready <= 0;
-			p_pong_ready <= 0;
+			ping_filled <= 0;
+			pong_filled <= 0;
 			c_ping_pong <= 1;
 			feature_index <= 0;
+			copy_sample <= 0;
 			burst_index <= 0;
 			features_ping <= 0;
 			features_pong <= 0;
+			valid_ping <= 0;
+			valid_pong <= 0;
 		end else begin
 			case (copy_st)
 				C_IDLE: begin
 					if (start) begin
 						copy_st <= C_WAIT;
-						p_ping_ready <= 0;
-						p_pong_ready <= 0;
+						ping_filled <= 0;
+						pong_filled <= 0;
 						burst_index <= 0;
 						feature_index <= 0;
 						c_ping_pong <= 1;
@@ -132,38 +199,50 @@ module trees_ping_pong #(
 				end
 				C_WAIT: begin
 					feature_index <= 0;
-					if (c_ping_ready && c_ping_pong)
-						copy_st <= C_PING;
-					if (c_pong_ready && !c_ping_pong)
-						copy_st <= C_PONG;
+					copy_sample <= 0;
 					if (burst_index == burst_len) begin
 						copy_st <= C_IDLE;
+					end else if (ping_filled == ping_taken && c_ping_pong) begin
+						copy_st <= C_PING;
+						valid_ping <= 0;
+					end else if (pong_filled == pong_taken && !c_ping_pong) begin
+						copy_st <= C_PONG;
+						valid_pong <= 0;
 					end
 				end
+				// Up to N_INFLIGHT samples per buffer, fewer at the end of the burst
 				C_PING: begin
 					if (feature_index < HALF_N_FEATURE) begin
-						features_ping[feature_index] <= 
+						features_ping[copy_sample][feature_index] <= 
 							features_mem[feature_index + {burst_index, {$clog2(HALF_N_FEATURE){1'b0}}}];
 						feature_index <= feature_index + 1;
-						p_ping_ready <= 0;
 					end else begin
 						burst_index <= burst_index + 1;
-						p_ping_ready <= 1;
-						c_ping_pong <= 0;
-						copy_st <= C_WAIT;
+						valid_ping[copy_sample] <= 1;
+						feature_index <= 0;
+						copy_sample <= copy_sample + 1;
+						if (copy_sample == N_INFLIGHT-1 || burst_index + 1 == burst_len) begin
+							ping_filled <= !ping_filled;
+							c_ping_pong <= 0;
+							copy_st <= C_WAIT;
+						end
 					end
 				end
 				C_PONG: begin
 					if (feature_index < HALF_N_FEATURE) begin
-						features_pong[feature_index] <= 
+						features_pong[copy_sample][feature_index] <= 
 							features_mem[feature_index + {burst_index, {$clog2(HALF_N_FEATURE){1'b0}}}];
 						feature_index <= feature_index + 1;
-						p_pong_ready <= 0;
 					end else begin
 						burst_index <= burst_index + 1;
-						p_pong_ready <= 1;
-						c_ping_pong <= 1;
-						copy_st <= C_WAIT;
+						valid_pong[copy_sample] <= 1;
+						feature_index <= 0;
+						copy_sample <= copy_sample + 1;
+						if (copy_sample == N_INFLIGHT-1 || burst_index + 1 == burst_len) begin
+							pong_filled <= !pong_filled;
+							c_ping_pong <= 1;
+							copy_st <= C_WAIT;
+						end
 					end
 				end
 			endcase
@@ -172,80 +251,69 @@ module trees_ping_pong #(
 
 	// ---------------------------------------------------
 	//  PROCESS FEATURES PING PONG
+	//  A buffer is launched as soon as the trees can take
+	//  a new start, while the samples launched before are
+	//  still being voted. The predictions come back in
+	//  launch order, one done_set per sample.
 	// ---------------------------------------------------
 	always_ff @(posedge clk or negedge rst_n) begin
 		if (!rst_n) begin
 			proc_st <= P_IDLE;
-			c_ping_ready <= 1;
-			c_pong_ready <= 1;
+			ping_taken <= 0;
+			pong_taken <= 0;
 			p_ping_pong <= 1;
 			prediction_packed <= 0;
 			start_set <= 0;
 			load_predictions <= 0;
 			prediction_index <= 0;
+			valid_mux <= 0;
 		end else begin
 			case (proc_st)
 				P_IDLE: begin
 					start_set <= 0;
 					done <= 0;
+					load_predictions <= 0;
 					prediction_packed <= 0;
 					if (start) begin
-						proc_st <= P_WAIT;
-						c_ping_ready <= 1;
-						c_pong_ready <= 1;
+						proc_st <= P_RUN;
+						ping_taken <= 0;
+						pong_taken <= 0;
 						p_ping_pong <= 1;
 						prediction_index <= 0;
 					end
 				end
-				P_WAIT: begin
-					load_predictions <= 0;
-					c_ping_ready <= idle_sys;
-					if (p_ping_ready && p_ping_pong && idle_sys) begin
-						proc_st <= P_PING;
-						start_set <= 1;
-						c_ping_ready <= 0;
-						/* 
-						Each 64-bit word in features_ping contains two 32-bit features;
-						the assignment to features_mux splits them to feed the tree ensemble.
-						*/
-						features_mux <= features_ping;
-					end
-					c_pong_ready <= idle_sys;
-					if (p_pong_ready && !p_ping_pong && idle_sys) begin
-						proc_st <= P_PONG;
-						start_set <= 1;
-						c_pong_ready <= 0;
-						/* 
-						Each 64-bit word in features_ping contains two 32-bit features;
-						the assignment to features_mux splits them to feed the tree ensemble.
-						*/
-						features_mux <= features_pong;
-					end
-					if (prediction_index == burst_len) begin
-						proc_st <= P_IDLE;
-						done <= 1;
-					end
-				end
-				P_PING: begin
+				P_RUN: begin
 					start_set <= 0;
-					if (done_set) begin
-						load_predictions <= 1;
-						prediction_packed[prediction_index[2:0]] <= prediction_set[7:0];
-						prediction_index <= prediction_index + 1;
-						proc_st <= P_WAIT;
-						c_ping_ready <= 1;
-						p_ping_pong <= 0;
+					if (idle_sys && !start_set) begin
+						if (ping_filled != ping_taken && p_ping_pong) begin
+							start_set <= 1;
+							ping_taken <= !ping_taken;
+							p_ping_pong <= 0;
+							/* 
+							Each 64-bit word in features_ping contains two 32-bit features;
+							the assignment to features_mux splits them to feed the tree ensemble.
+							*/
+							features_mux <= features_ping;
+							valid_mux <= valid_ping;
+						end
+						if (pong_filled != pong_taken && !p_ping_pong) begin
+							start_set <= 1;
+							pong_taken <= !pong_taken;
+							p_ping_pong <= 1;
+							features_mux <= features_pong;
+							valid_mux <= valid_pong;
+						end
 					end
-				end
-				P_PONG: begin
-					start_set <= 0;
+
+					load_predictions <= done_set;
 					if (done_set) begin
-						load_predictions <= 1;
 						prediction_packed[prediction_index[2:0]] <= prediction_set[7:0];
 						prediction_index <= prediction_index + 1;
-						proc_st <= P_WAIT;
-						c_pong_ready <= 1;
-						p_ping_pong <= 1;
+					end
+
+					if (prediction_index == burst_len) begin
+						proc_st <= P_IDLE;
+						done <= 1;
 					end
 				end
 			endcase
@@ -3,7 +3,12 @@ module trees_rtl_basic_dma64 #(
 	parameter N_NODE_AND_LEAFS 					= 256,		// POWER OF 2
 	parameter N_FEATURE        					= 32,
 	parameter N_CLASES  		       			= 32,
-	parameter MAX_BURST        					= 5000
+	parameter MAX_BURST        					= 5000,
+	parameter VOTE_COUNTS      					= 0,		// Per-class vote output mode, only for split-model builds
+	parameter N_INFLIGHT       					= 2,		// Samples each tree engine walks at once
+	parameter ARGMAX           					= 1,		// Vote argmax: 0 scan, 1 comparator tree, 2 pipelined tree
+	parameter DUAL_PORT        					= 0,		// Two tree engines per BRAM, one per read port (even N_INFLIGHT)
+	parameter EARLY_EXIT       					= 0			// Stop counting once the winner is fixed (ARGMAX = 1)
 ) (
 	input  logic        clk,
 	input  logic        rst,                          // Active-low reset
@@ -11,6 +16,9 @@ module trees_rtl_basic_dma64 #(
 	// Configuration
 	input  logic [31:0] conf_info_load_trees,
 	input  logic [31:0] conf_info_burst_len,
+	input  logic [31:0] conf_info_vote_counts,
+	input  logic [31:0] conf_info_tree_offset,		// First tree to load
+	input  logic [31:0] conf_info_tree_count,		// Trees to load, 0 loads all N_TREES
 	input  logic        conf_done,
 
 	// Accelerator status
@@ -44,6 +52,10 @@ module trees_rtl_basic_dma64 #(
 );
 
 	localparam integer TREES_LEN_BITS  = $clog2(N_NODE_AND_LEAFS);
+	// 64-bit words of vote counts written per sample, one byte per class
+	localparam integer VOTE_WORDS      = 1 << $clog2((N_CLASES + 7) / 8);
+	// Capability word of the build, bit 0: per-class vote output
+	localparam logic [63:0] CAPS       = 64'(VOTE_COUNTS != 0);
 
 	typedef enum logic [2:0] {
 		IDLE      = 0,
@@ -60,6 +72,10 @@ module trees_rtl_basic_dma64 #(
 	logic                           end_compute;
 	logic                           load_features;
 	logic [63:0]                    prediction;
+	logic [63:0]                    votes;
+	logic                           vote_counts_ff;
+	logic                           status_run;			// no inference, writes CAPS and the stamps
+	logic [31:0]                    read_addr;
 	logic                           start;
 	logic                           writing;
 
@@ -67,6 +83,9 @@ module trees_rtl_basic_dma64 #(
 
 	logic [31:0]                    clk_stamp1, clk_stamp2;
 	logic [31:0] 					conf_info_burst_len_ff;
+	logic [31-TREES_LEN_BITS:0]     tree_offset_ff;
+	logic [31:0]                    tree_room;			// trees from tree_offset to the last one
+	logic [31:0]                    trees_to_load;
 
 
 
@@ -77,7 +96,13 @@ module trees_rtl_basic_dma64 #(
 		.N_NODE_AND_LEAFS(N_NODE_AND_LEAFS),
 		.N_FEATURE(N_FEATURE),
 	    .N_CLASES(N_CLASES),
-		.MAX_BURST(MAX_BURST)
+		.MAX_BURST(MAX_BURST),
+		.VOTE_COUNTS(VOTE_COUNTS),
+		.VOTE_WORDS(VOTE_WORDS),
+		.N_INFLIGHT(N_INFLIGHT),
+		.ARGMAX(ARGMAX),
+		.DUAL_PORT(DUAL_PORT),
+		.EARLY_EXIT(EARLY_EXIT)
 	) trees_ping_pong_ins (
 		.clk(clk),
 		.rst_n(rst),
@@ -92,9 +117,11 @@ module trees_rtl_basic_dma64 #(
 		.feature_addr(rd_ptr),
 		.burst_len(conf_info_burst_len_ff),
 		.features2(dma_read_chnl_data),
+		.vote_counts(vote_counts_ff),
 
 		.prediction(prediction),
-		.prediction_addr(wr_ptr),
+		.votes(votes),
+		.prediction_addr(read_addr),
 		.done(end_compute)
 	);
 
@@ -120,6 +147,9 @@ module trees_rtl_basic_dma64 #(
 			wr_ptr                  	<= 0;
 			start                   	<= 0;
 			load_features           	<= 0;
+			vote_counts_ff          	<= 0;
+			status_run              	<= 0;
+			tree_offset_ff          	<= 0;
 			clk_stamp1			 		<= 0;
 			clk_stamp2			 		<= 0;
 
@@ -131,18 +161,36 @@ module trees_rtl_basic_dma64 #(
 					clk_stamp2 <= 0;
 					load_features <= 0;
 					if (conf_done) begin
+						status_run <= conf_info_load_trees[0] || (conf_info_vote_counts[0] && VOTE_COUNTS == 0);
 						if (conf_info_load_trees[0]) begin
-							// If conf_info_load_trees[0] is set, we load trees
-							dma_read_ctrl_valid       <= 1;
-							dma_read_ctrl_data_length <= N_TREES * N_NODE_AND_LEAFS;
-							state 				      <= DMA_READ;
-							dma_read_ctrl_data_size   <= 3'b011;
-							dma_read_ctrl_data_user   <= 0;
-							dma_read_chnl_ready       <= 1;	
+							// If conf_info_load_trees[0] is set, we load trees.
+							// Only the trees [tree_offset, tree_offset + tree_count) are read,
+							// from their place in the model, the rest stay resident.
+							// The range is cut at N_TREES so it never wraps over tree 0
+							if (trees_to_load != 0) begin
+								dma_read_ctrl_valid       <= 1;
+								dma_read_ctrl_data_index  <= conf_info_tree_offset * N_NODE_AND_LEAFS;
+								dma_read_ctrl_data_length <= trees_to_load * N_NODE_AND_LEAFS;
+								tree_offset_ff            <= conf_info_tree_offset;
+								state 				      <= DMA_READ;
+								dma_read_ctrl_data_size   <= 3'b011;
+								dma_read_ctrl_data_user   <= 0;
+								dma_read_chnl_ready       <= 1;	
+							end else begin
+								// Nothing to load, only CAPS and the clock stamps are written
+								state <= COMPUTE;
+							end
+						end else if (conf_info_vote_counts[0] && VOTE_COUNTS == 0) begin
+							// This build has no vote output. The run is refused instead of
+							// writing the winners as votes, the host finds bit 0 of CAPS clear
+							state <= COMPUTE;
 						end else begin
+							// Output the votes of every class instead of the winner
+							vote_counts_ff <= conf_info_vote_counts[0];
 							if (conf_info_burst_len != 0) begin
 								// If conf_info_load_trees[0] is not set, we load features
 								dma_read_ctrl_valid       <= 1;
+								dma_read_ctrl_data_index  <= 0;
 								dma_read_ctrl_data_length <= (conf_info_burst_len * N_FEATURE + 1) >> 1; // FEATURES COME IN PAIRS
 								state <= DMA_READ;
 								dma_read_ctrl_data_size   <= 3'b011;
@@ -184,16 +232,20 @@ module trees_rtl_basic_dma64 #(
 				COMPUTE: begin
 					clk_stamp2 <= clk_stamp2 + 1;
 					start <= 0;
-					if (conf_info_load_trees[0]) begin
+					if (status_run) begin
 						dma_write_ctrl_valid       <= 1;
-						dma_write_ctrl_data_length <= 1;	// performance CLK
+						dma_write_ctrl_data_length <= 2;	// CAPS + performance CLK
 						dma_write_ctrl_data_size   <= 3'b011;
 						dma_write_ctrl_data_user   <= 0;
 						state                      <= DMA_WRITE;
 					end else if (end_compute) begin
 						dma_write_ctrl_valid       <= 1;
-						//ceil(x) / 8) + performance CLK
-						dma_write_ctrl_data_length <= ((conf_info_burst_len_ff + 7) >> 3) + 1;
+						if (vote_counts_ff)
+							// VOTE_WORDS per sample + performance CLK
+							dma_write_ctrl_data_length <= conf_info_burst_len_ff * VOTE_WORDS + 1;
+						else
+							//ceil(x) / 8) + performance CLK
+							dma_write_ctrl_data_length <= ((conf_info_burst_len_ff + 7) >> 3) + 1;
 						
 						dma_write_ctrl_data_size   <= 3'b011;
 						dma_write_ctrl_data_user   <= 0;
@@ -237,21 +289,33 @@ module trees_rtl_basic_dma64 #(
 
 	always_comb begin
 		if (state == DMA_WRITE) begin
-			if (conf_info_load_trees[0])
+			if (wr_ptr == dma_write_ctrl_data_length-1)
 				dma_write_chnl_data = {clk_stamp1, clk_stamp2};
+			else if (status_run)
+				dma_write_chnl_data = CAPS;
+			else if (vote_counts_ff)
+				dma_write_chnl_data = votes;
 			else
-				if (wr_ptr == dma_write_ctrl_data_length-1)
-					dma_write_chnl_data = {clk_stamp1, clk_stamp2};
-				else
-					dma_write_chnl_data = prediction;
+				dma_write_chnl_data = prediction;
 		end else begin
 			dma_write_chnl_data = 64'd0;
 		end
 	end
 
+	always_comb begin
+		tree_room     = conf_info_tree_offset < N_TREES ? N_TREES - conf_info_tree_offset : 0;
+		trees_to_load = (conf_info_tree_count == 0 || conf_info_tree_count > tree_room) ?
+							tree_room : conf_info_tree_count;
+	end
+
+	// The result memories have a registered read: the address runs one beat
+	// ahead of wr_ptr while the channel takes a beat
+	always_comb
+		read_addr = (state == DMA_WRITE && writing && dma_write_chnl_ready) ? wr_ptr + 1 : wr_ptr;
+
 	always_comb begin
 		address_node = rd_ptr[TREES_LEN_BITS-1:0];
-		address_tree = rd_ptr[31:TREES_LEN_BITS];
+		address_tree = rd_ptr[31:TREES_LEN_BITS] + tree_offset_ff;
 	end
 
 endmodule